@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <sys/time.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include "pathtable.h"                   /* path_id_t */
+#include "handlemap.h"                   /* HandleMap */
+#include "slab.h"                        /* mpileaks_slab_footprint */
+
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+/*******************************************************
+ * Compares the HandleMap of the trackers with the
+ * std::map it replaced.  For 10^3, 10^4, ... handles,
+ * it inserts them with a value like that of Handle2Set,
+ * looks each one up and then erases them, both in
+ * random order, and prints the time per lookup and per
+ * erase as well as the bytes per handle.  Handles
+ * are integers, as in MPICH.  The first argument sets
+ * the largest power of ten.
+ *******************************************************/
+
+#define MAX_POWER 6
+
+typedef pair<set<path_id_t>,int> entry_t;
+
+static double usecs()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double) tv.tv_sec * 1000000.0 + (double) tv.tv_usec;
+}
+
+/* bytes on the heap plus those mapped for the mpileaks slabs */
+static long heap_bytes()
+{
+  struct mallinfo info = mallinfo();
+  size_t slab_current, slab_peak;
+  mpileaks_slab_footprint(&slab_current, &slab_peak);
+  return (long) info.uordblks + (long) info.hblkhd + (long) slab_current;
+}
+
+/* time lookups and erases of count handles in map, in ns per operation,
+ * and the bytes the map holds per handle */
+template<class M> static void measure(
+  M& map, const vector<int>& handles, const vector<int>& order,
+  double* find_time, double* erase_time, double* bytes)
+{
+  size_t count = handles.size();
+  size_t i;
+
+  long base = heap_bytes();
+  for (i = 0; i < count; i++) {
+    entry_t& entry = map[handles[i]];
+    entry.first.insert((path_id_t) (i % 64));
+    entry.second = 1;
+  }
+  *bytes = (double) (heap_bytes() - base) / (double) count;
+
+  volatile int sink = 0;
+  double start = usecs();
+  for (i = 0; i < count; i++) {
+    sink += map.find(order[i])->second.second;
+  }
+  *find_time = (usecs() - start) * 1000.0 / (double) count;
+
+  start = usecs();
+  for (i = 0; i < count; i++) {
+    map.erase(map.find(order[i]));
+  }
+  *erase_time = (usecs() - start) * 1000.0 / (double) count;
+}
+
+int main(int argc, char *argv[])
+{
+  int p;
+  int max_power = MAX_POWER;
+
+  if (argc > 1) {
+    max_power = atoi(argv[1]);
+  }
+
+  printf("%10s %12s %12s %12s %12s %12s %12s\n", "handles",
+    "map ns/find", "ns/erase", "bytes",
+    "hmap ns/find", "ns/erase", "bytes"
+  );
+
+  srand(1);
+  size_t count = 1;
+  for (p = 1; p <= max_power; p++) {
+    count *= 10;
+    if (p < 3) {
+      continue;
+    }
+
+    /* MPICH-like handles, created in one order and used in another */
+    vector<int> handles(count);
+    size_t i;
+    for (i = 0; i < count; i++) {
+      handles[i] = 0x4c000000 + (int) i;
+    }
+    vector<int> order(handles);
+    random_shuffle(order.begin(), order.end());
+
+    double map_find, map_erase, map_bytes;
+    {
+      map<int, entry_t> m;
+      measure(m, handles, order, &map_find, &map_erase, &map_bytes);
+    }
+
+    double hmap_find, hmap_erase, hmap_bytes;
+    {
+      HandleMap<int, entry_t> m;
+      measure(m, handles, order, &hmap_find, &hmap_erase, &hmap_bytes);
+    }
+
+    /* unmap the slabs, so the next size does not reuse them */
+    mpileaks_slab_release();
+
+    printf("%10lu %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f\n", (unsigned long) count,
+      map_find, map_erase, map_bytes, hmap_find, hmap_erase, hmap_bytes
+    );
+  }
+
+  return 0;
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <sys/time.h>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include "pathtable.h"                   /* path_id_t */
+#include "handlemap.h"                   /* HandleMap */
+#include "slab.h"                        /* mpileaks_slab_footprint */
+#include "allocset.h"                    /* AllocSet */
+
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+/*******************************************************
+ * Compares the entries of Handle2Set, an AllocSet of
+ * call paths and generations, with the std::set and
+ * count they replaced.  For 10^3, 10^4, ... handles, it
+ * adds each handle from one or from two call paths, the
+ * way add_callpath does, and then removes them in random
+ * order, the way remove_callpath does.  It prints the
+ * time per add and per remove and the bytes per handle.
+ * The first argument sets the largest power of ten.
+ *******************************************************/
+
+#define MAX_POWER 6
+#define MAX_PATHS 2
+
+static double usecs()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double) tv.tv_sec * 1000000.0 + (double) tv.tv_usec;
+}
+
+/* bytes on the heap plus those mapped for the mpileaks slabs */
+static long heap_bytes()
+{
+  struct mallinfo info = mallinfo();
+  size_t slab_current, slab_peak;
+  mpileaks_slab_footprint(&slab_current, &slab_peak);
+  return (long) info.uordblks + (long) info.hblkhd + (long) slab_current;
+}
+
+typedef pair<set<path_id_t>,int> set_entry;
+
+/* record an allocation in the entry of a handle */
+static void add(set_entry& entry, path_id_t path, uint32_t generation)
+{
+  entry.first.insert(path);
+  entry.second++;
+}
+
+static void add(AllocSet& entry, path_id_t path, uint32_t generation)
+{
+  entry.push(path, generation);
+}
+
+/* remove the newest allocation from the entry of a handle,
+ * returns true if the entry is left empty */
+static bool remove(set_entry& entry)
+{
+  entry.second--;
+  if (entry.second == 0) {
+    entry.first.clear();
+    return true;
+  }
+  return false;
+}
+
+static bool remove(AllocSet& entry)
+{
+  entry.retire(entry.newest().generation);
+  return entry.empty();
+}
+
+/* add each handle from paths call paths and then remove all of them,
+ * returns ns per add and per remove and bytes per handle */
+template<class S> static void measure(
+  const vector<int>& handles, const vector<int>& order, int paths,
+  double* add_time, double* remove_time, double* bytes)
+{
+  HandleMap<int, S> map;
+  size_t count = handles.size();
+  uint32_t generation = 0;
+  size_t i;
+  int k;
+
+  long base = heap_bytes();
+  double start = usecs();
+  for (k = 0; k < paths; k++) {
+    for (i = 0; i < count; i++) {
+      add(map[handles[i]], (path_id_t) (k * 64 + i % 64), ++generation);
+    }
+  }
+  *add_time = (usecs() - start) * 1000.0 / (double) (count * paths);
+  *bytes = (double) (heap_bytes() - base) / (double) count;
+
+  start = usecs();
+  for (k = 0; k < paths; k++) {
+    for (i = 0; i < count; i++) {
+      typename HandleMap<int, S>::iterator it = map.find(order[i]);
+      if (remove(it->second)) {
+        map.erase(it);
+      }
+    }
+  }
+  *remove_time = (usecs() - start) * 1000.0 / (double) (count * paths);
+}
+
+int main(int argc, char *argv[])
+{
+  int p, paths;
+  int max_power = MAX_POWER;
+
+  if (argc > 1) {
+    max_power = atoi(argv[1]);
+  }
+
+  printf("%10s %6s %12s %12s %12s %12s %12s %12s\n", "handles", "paths",
+    "set ns/add", "ns/remove", "bytes",
+    "aset ns/add", "ns/remove", "bytes"
+  );
+
+  srand(1);
+  size_t count = 1;
+  for (p = 1; p <= max_power; p++) {
+    count *= 10;
+    if (p < 3) {
+      continue;
+    }
+
+    vector<int> handles(count);
+    size_t i;
+    for (i = 0; i < count; i++) {
+      handles[i] = 0x4c000000 + (int) i;
+    }
+    vector<int> order(handles);
+    random_shuffle(order.begin(), order.end());
+
+    for (paths = 1; paths <= MAX_PATHS; paths++) {
+      double set_add, set_remove, set_bytes;
+      measure<set_entry>(handles, order, paths, &set_add, &set_remove, &set_bytes);
+
+      double aset_add, aset_remove, aset_bytes;
+      measure<AllocSet>(handles, order, paths, &aset_add, &aset_remove, &aset_bytes);
+      mpileaks_slab_release();
+
+      printf("%10lu %6d %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f\n", (unsigned long) count, paths,
+        set_add, set_remove, set_bytes, aset_add, aset_remove, aset_bytes
+      );
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <sys/time.h>
+#include <stack>
+#include <vector>
+#include <algorithm>
+#include "pathtable.h"                   /* path_id_t */
+#include "handlemap.h"                   /* HandleMap */
+#include "slab.h"                        /* mpileaks_slab_footprint */
+#include "pathstack.h"                   /* PathStack */
+
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+/*******************************************************
+ * Compares the entries of Handle2Stack, a PathStack,
+ * with the std::stack they replaced.  No MPI wrapper
+ * uses Handle2Stack, so this fills a HandleMap with
+ * either kind of entry directly: it pushes 1, 2, ...
+ * paths on the stack of each handle, the way
+ * add_callpath does, and then pops them in random order
+ * of handles, the way remove_callpath does.  It prints
+ * the bytes per handle and the time per push and
+ * per pop.  The first argument sets the number of
+ * handles.
+ *******************************************************/
+
+#define NHANDLES 100000
+#define MAX_PATHS 4
+
+static double usecs()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double) tv.tv_sec * 1000000.0 + (double) tv.tv_usec;
+}
+
+/* bytes on the heap plus those mapped for the mpileaks slabs */
+static long heap_bytes()
+{
+  struct mallinfo info = mallinfo();
+  size_t slab_current, slab_peak;
+  mpileaks_slab_footprint(&slab_current, &slab_peak);
+  return (long) info.uordblks + (long) info.hblkhd + (long) slab_current;
+}
+
+/* push paths on the stack of each handle and then pop all of them,
+ * returns ns per push and per pop and bytes per handle */
+template<class S> static void measure(
+  const vector<int>& handles, const vector<int>& order, int paths,
+  double* push_time, double* pop_time, double* bytes)
+{
+  HandleMap<int, S> map;
+  size_t count = handles.size();
+  size_t i;
+  int k;
+
+  long base = heap_bytes();
+  double start = usecs();
+  for (k = 0; k < paths; k++) {
+    for (i = 0; i < count; i++) {
+      map[handles[i]].push((path_id_t) (k * 64 + i % 64));
+    }
+  }
+  *push_time = (usecs() - start) * 1000.0 / (double) (count * paths);
+  *bytes = (double) (heap_bytes() - base) / (double) count;
+
+  start = usecs();
+  for (k = 0; k < paths; k++) {
+    for (i = 0; i < count; i++) {
+      typename HandleMap<int, S>::iterator it = map.find(order[i]);
+      it->second.pop();
+      if (it->second.empty()) {
+        map.erase(it);
+      }
+    }
+  }
+  *pop_time = (usecs() - start) * 1000.0 / (double) (count * paths);
+}
+
+int main(int argc, char *argv[])
+{
+  int paths;
+  int nhandles = NHANDLES;
+
+  if (argc > 1) {
+    nhandles = atoi(argv[1]);
+  }
+
+  vector<int> handles(nhandles);
+  int i;
+  for (i = 0; i < nhandles; i++) {
+    handles[i] = 0x4c000000 + i;
+  }
+  srand(1);
+  vector<int> order(handles);
+  random_shuffle(order.begin(), order.end());
+
+  printf("%10s %6s %12s %12s %12s %12s %12s %12s\n", "handles", "paths",
+    "stack bytes", "ns/push", "ns/pop",
+    "pstack bytes", "ns/push", "ns/pop"
+  );
+
+  for (paths = 1; paths <= MAX_PATHS; paths++) {
+    double stack_push, stack_pop, stack_bytes;
+    measure< stack<path_id_t> >(handles, order, paths, &stack_push, &stack_pop, &stack_bytes);
+
+    double pstack_push, pstack_pop, pstack_bytes;
+    measure<PathStack>(handles, order, paths, &pstack_push, &pstack_pop, &pstack_bytes);
+    mpileaks_slab_release();
+
+    printf("%10d %6d %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f\n", nhandles, paths,
+      stack_bytes, stack_push, stack_pop, pstack_bytes, pstack_push, pstack_pop
+    );
+  }
+
+  return 0;
+}
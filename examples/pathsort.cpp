@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <vector>
+#include <algorithm>
+#include "CallpathRuntime.h"             /* Callpath */
+#include "fingerprint.h"                 /* mpileaks_fingerprint */
+
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+/*******************************************************
+ * Compares the two ways mpileaks can hash and order
+ * call paths: the FNV-1a hash of return addresses and
+ * callpath_path_lt, which walk each path frame by
+ * frame, against the CRC32C fingerprints, which order
+ * paths by a single 64-bit compare and only fall back
+ * to the frames when fingerprints are equal.  It builds
+ * paths of 10 to 30 frames that share their outer
+ * frames, as the paths from one application do, and
+ * prints the time per path to hash one and the time to
+ * sort all of them either way.  The first argument sets
+ * the number of paths.
+ *******************************************************/
+
+#define PATHS 2000
+#define MIN_DEPTH 10
+#define MAX_DEPTH 30
+#define REPEAT 100
+
+struct sort_item {
+  Callpath path;
+  uint64_t fingerprint;
+};
+
+/* FNV-1a over the return addresses */
+static uint64_t fnv1a(const uintptr_t* words, size_t count)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  size_t i;
+  for (i = 0; i < count; i++) {
+    hash ^= (uint64_t) words[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static bool compare_frames(const sort_item& first, const sort_item& second)
+{
+  callpath_path_lt lt;
+  return lt(first.path, second.path);
+}
+
+/* same order as compare_callpaths in mpileaks.cpp */
+static bool compare_fingerprints(const sort_item& first, const sort_item& second)
+{
+  if (first.fingerprint != second.fingerprint) {
+    return (first.fingerprint < second.fingerprint);
+  }
+  if (first.path == second.path) {
+    return false;
+  }
+  callpath_path_lt lt;
+  return lt(first.path, second.path);
+}
+
+static double usecs()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double) tv.tv_sec * 1000000.0 + (double) tv.tv_usec;
+}
+
+int main(int argc, char *argv[])
+{
+  int i, j, r;
+  int paths = PATHS;
+
+  if (argc > 1) {
+    paths = atoi(argv[1]);
+  }
+
+  /* paths share their outer frames and differ towards the leaf */
+  srand(1);
+  ModuleId module("pathsort");
+  std::vector< std::vector<uintptr_t> > words(paths);
+  std::vector<sort_item> items(paths);
+  for (i = 0; i < paths; i++) {
+    int depth = MIN_DEPTH + rand() % (MAX_DEPTH - MIN_DEPTH + 1);
+    std::vector<FrameId> frames;
+    for (j = 0; j < depth; j++) {
+      uintptr_t offset = 0x1000 + 0x10 * j;
+      if (j >= depth - 3) {
+        offset += rand() % 64;
+      }
+      words[i].push_back(offset);
+      frames.push_back(FrameId(module, offset));
+    }
+    items[i].path = Callpath::create(frames);
+    items[i].fingerprint = mpileaks_fingerprint_callpath(items[i].path);
+  }
+
+  /* hash the raw return addresses */
+  volatile uint64_t sink = 0;
+  double start = usecs();
+  for (r = 0; r < REPEAT; r++) {
+    for (i = 0; i < paths; i++) {
+      sink ^= fnv1a(&words[i][0], words[i].size());
+    }
+  }
+  double fnv_time = (usecs() - start) * 1000.0 / ((double) REPEAT * paths);
+
+  start = usecs();
+  for (r = 0; r < REPEAT; r++) {
+    for (i = 0; i < paths; i++) {
+      sink ^= mpileaks_fingerprint(&words[i][0], words[i].size());
+    }
+  }
+  double crc_time = (usecs() - start) * 1000.0 / ((double) REPEAT * paths);
+
+  /* sort the paths, starting from the same shuffled order each time */
+  std::vector<sort_item> shuffled(items);
+  std::random_shuffle(shuffled.begin(), shuffled.end());
+
+  double frames_time = 0.0;
+  double fingerprints_time = 0.0;
+  for (r = 0; r < REPEAT; r++) {
+    std::vector<sort_item> sorted(shuffled);
+    start = usecs();
+    std::sort(sorted.begin(), sorted.end(), compare_frames);
+    frames_time += usecs() - start;
+
+    sorted = shuffled;
+    start = usecs();
+    std::sort(sorted.begin(), sorted.end(), compare_fingerprints);
+    fingerprints_time += usecs() - start;
+  }
+  frames_time /= (double) REPEAT;
+  fingerprints_time /= (double) REPEAT;
+
+  printf("%8s %16s %16s %16s %16s\n", "paths", "ns/fnv1a", "ns/crc32c", "us/sort frames", "us/sort fprints");
+  printf("%8d %16.1f %16.1f %16.1f %16.1f\n", paths, fnv_time, crc_time, frames_time, fingerprints_time);
+
+  return 0;
+}
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "mpi.h"
+
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+/*******************************************************
+ * Counts the heap allocations made while tracking and
+ * while reporting.  This program defines malloc, calloc
+ * and realloc itself, so that the calls of the library
+ * and of mpileaks come here too, and passes them on to
+ * the glibc functions.  It first creates and frees
+ * MPI_Info objects once tables are warm, then leaks a
+ * few objects from each of many distinct call paths and
+ * counts the allocations of MPI_Pcontrol(2), which
+ * sorts, merges and prints them.  Each process leaks
+ * from its own paths, so that merging the lists of two
+ * processes adds every path of one to the other, and
+ * copying a path would allocate.  Run once without
+ * mpileaks for a baseline and once with it, e.g., with
+ *
+ *   MPILEAKS_STACK_DEPTH=-1
+ *
+ * so that the call paths differ in their length.  The
+ * counts go to stderr, so the report on stdout can be
+ * sent to /dev/null or a file.  The first argument sets
+ * the number of paths, the second the number of objects
+ * created and freed.
+ *******************************************************/
+
+#define PATHS 64
+#define ALLOCS 4
+#define NOBJECTS 100000
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+/* allocations are only counted while this is set */
+static volatile int counting = 0;
+static volatile unsigned long allocations = 0;
+
+void* malloc(size_t size)
+{
+  if (counting) {
+    allocations++;
+  }
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+  if (counting) {
+    allocations++;
+  }
+  return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+  if (counting) {
+    allocations++;
+  }
+  return __libc_realloc(ptr, size);
+}
+
+static MPI_Info* infos;
+static int ninfos = 0;
+
+/* leak allocs objects from a call path depth frames below the caller,
+ * the volatile keeps the compiler from turning calls into jumps */
+static int leak(int depth, int allocs)
+{
+  volatile int n = 0;
+  if (depth > 0) {
+    n = leak(depth - 1, allocs);
+  } else {
+    int i;
+    for (i = 0; i < allocs; i++) {
+      MPI_Info_create(&infos[ninfos]);
+      ninfos++;
+    }
+    n = allocs;
+  }
+  return n;
+}
+
+int main(int argc, char *argv[])
+{
+  int myrank, i;
+  int paths    = PATHS;
+  int nobjects = NOBJECTS;
+  MPI_Info info;
+
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
+
+  if (argc > 1) {
+    paths = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    nobjects = atoi(argv[2]);
+  }
+
+  infos = (MPI_Info*) malloc(paths * ALLOCS * sizeof(MPI_Info));
+
+  /* warm up, so that tables have grown and the path is known */
+  for (i = 0; i < 1000; i++) {
+    MPI_Info_create(&info);
+    MPI_Info_free(&info);
+  }
+
+  /* tracking, from one call path */
+  allocations = 0;
+  counting = 1;
+  for (i = 0; i < nobjects; i++) {
+    MPI_Info_create(&info);
+    MPI_Info_free(&info);
+  }
+  counting = 0;
+  unsigned long track_allocations = allocations;
+
+  /* reporting, one leaked path per depth, the depths of each
+   * process follow those of the process before it */
+  for (i = 0; i < paths; i++) {
+    leak(myrank * paths + i, ALLOCS);
+  }
+
+  allocations = 0;
+  counting = 1;
+  MPI_Pcontrol(2);
+  counting = 0;
+  unsigned long report_allocations = allocations;
+
+  for (i = 0; i < ninfos; i++) {
+    MPI_Info_free(&infos[i]);
+  }
+
+  double counts[2], max[2];
+  counts[0] = (double) track_allocations / (double) nobjects;
+  counts[1] = (double) report_allocations / (double) paths;
+  MPI_Reduce(counts, max, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  if (myrank == 0) {
+    fprintf(stderr, "%8s %8s %20s %20s\n", "paths", "objects", "allocs/create+free", "allocs/report path");
+    fprintf(stderr, "%8d %8d %20.3f %20.3f\n", paths, nobjects, max[0], max[1]);
+  }
+
+  free(infos);
+
+  MPI_Finalize();
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "mpi.h"
+
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+/*******************************************************
+ * Measures the cost of an MPI_Isend/MPI_Irecv/MPI_Waitall
+ * exchange with oneself as a function of the depth of the
+ * call stack at the call site.  Run once without mpileaks
+ * for a baseline, and then with mpileaks under different
+ * settings, e.g.,
+ *
+ *   MPILEAKS_STACK_DEPTH=-1
+ *   MPILEAKS_STACK_DEPTH=3
+ *   MPILEAKS_STACK_DEPTH=1
+ *   MPILEAKS_UNWINDER=framepointer
+ *
+ * to compare the capture time of unbounded and bounded walks.
+ *******************************************************/
+
+#define ITERS 10000
+#define MAX_DEPTH 64
+
+static double exchange(int iters)
+{
+  int i, sendval = 0, recvval;
+  MPI_Request req[2];
+
+  double start = MPI_Wtime();
+  for (i = 0; i < iters; i++) {
+    MPI_Irecv(&recvval, 1, MPI_INT, 0, 0, MPI_COMM_SELF, &req[0]);
+    MPI_Isend(&sendval, 1, MPI_INT, 0, 0, MPI_COMM_SELF, &req[1]);
+    MPI_Waitall(2, req, MPI_STATUSES_IGNORE);
+  }
+  return MPI_Wtime() - start;
+}
+
+/* recurse to the requested depth before timing, the volatile
+ * keeps the compiler from turning this into a loop */
+static double recurse(int depth, int iters)
+{
+  volatile double time;
+  if (depth > 0) {
+    time = recurse(depth - 1, iters);
+  } else {
+    time = exchange(iters);
+  }
+  return time;
+}
+
+int main(int argc, char *argv[])
+{
+  int myrank, depth;
+  int iters = ITERS;
+
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
+
+  if (argc > 1) {
+    iters = atoi(argv[1]);
+  }
+
+  /* warm up, e.g., let the unwinders load what they need */
+  recurse(0, 100);
+
+  if (myrank == 0) {
+    printf("%8s %16s\n", "depth", "usec/exchange");
+  }
+  for (depth = 0; depth <= MAX_DEPTH; depth += 8) {
+    double time = recurse(depth, iters);
+    double max;
+    MPI_Reduce(&time, &max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (myrank == 0) {
+      printf("%8d %16.3f\n", depth, max * 1000000.0 / (double) iters);
+    }
+  }
+
+  MPI_Finalize();
+  return 0;
+}
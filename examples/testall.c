@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "mpi.h"
+
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+/*******************************************************
+ * Measures the cost of polling an array of outstanding
+ * receive requests with MPI_Testall, and then of the
+ * MPI_Testall that completes all of them.  Run once
+ * without mpileaks for a baseline and once with it to
+ * see what mpileaks adds to each call.
+ *******************************************************/
+
+#define NREQS 1000
+#define POLLS 10000
+#define ROUNDS 10
+
+int main(int argc, char *argv[])
+{
+  int myrank, i, r, flag;
+  int nreqs = NREQS;
+  int polls = POLLS;
+
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
+
+  if (argc > 1) {
+    nreqs = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    polls = atoi(argv[2]);
+  }
+
+  int* sendvals = (int*) malloc(nreqs * sizeof(int));
+  int* recvvals = (int*) malloc(nreqs * sizeof(int));
+  MPI_Request* req = (MPI_Request*) malloc(nreqs * sizeof(MPI_Request));
+  for (i = 0; i < nreqs; i++) {
+    sendvals[i] = i;
+  }
+
+  double poll_time = 0.0;
+  double complete_time = 0.0;
+  for (r = 0; r < ROUNDS; r++) {
+    for (i = 0; i < nreqs; i++) {
+      MPI_Irecv(&recvvals[i], 1, MPI_INT, 0, i, MPI_COMM_SELF, &req[i]);
+    }
+
+    /* nothing has been sent yet, so none of these complete */
+    double start = MPI_Wtime();
+    for (i = 0; i < polls; i++) {
+      MPI_Testall(nreqs, req, &flag, MPI_STATUSES_IGNORE);
+    }
+    poll_time += MPI_Wtime() - start;
+
+    for (i = 0; i < nreqs; i++) {
+      MPI_Send(&sendvals[i], 1, MPI_INT, 0, i, MPI_COMM_SELF);
+    }
+
+    /* now all of them complete at once */
+    start = MPI_Wtime();
+    flag = 0;
+    while (!flag) {
+      MPI_Testall(nreqs, req, &flag, MPI_STATUSES_IGNORE);
+    }
+    complete_time += MPI_Wtime() - start;
+  }
+
+  double times[2], max[2];
+  times[0] = poll_time;
+  times[1] = complete_time;
+  MPI_Reduce(times, max, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  if (myrank == 0) {
+    printf("%8s %16s %16s\n", "requests", "usec/poll", "usec/complete");
+    printf("%8d %16.3f %16.3f\n", nreqs,
+           max[0] * 1000000.0 / (double) (polls * ROUNDS),
+           max[1] * 1000000.0 / (double) ROUNDS);
+  }
+
+  free(req);
+  free(recvvals);
+  free(sendvals);
+
+  MPI_Finalize();
+  return 0;
+}
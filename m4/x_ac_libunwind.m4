@@ -0,0 +1,75 @@
+##*****************************************************************************
+#  AUTHOR:
+#    Adam Moody <moody20@llnl.gov>
+#
+#  SYNOPSIS:
+#    X_AC_LIBUNWIND()
+#
+#  DESCRIPTION:
+#    Check the usual suspects for an optional libunwind installation,
+#    setting LIBUNWIND_CFLAGS, LIBUNWIND_LDFLAGS, and LIBUNWIND_LIBS as necessary.
+#    libunwind is only needed for the libunwind stack unwinder.
+#
+#  WARNINGS:
+#    This macro must be placed after AC_PROG_CC and before AC_PROG_LIBTOOL.
+##*****************************************************************************
+
+AC_DEFUN([X_AC_LIBUNWIND], [
+
+  _x_ac_libunwind_dirs="/usr /opt/freeware"
+  _x_ac_libunwind_libs="lib64 lib"
+
+  AC_ARG_WITH(
+    [libunwind],
+    AS_HELP_STRING(--with-libunwind=PATH,Specify libunwind path to enable the libunwind stack unwinder),
+    [if test "x$withval" != xyes ; then
+       _x_ac_libunwind_dirs="$withval"
+     fi
+     with_libunwind=yes],
+    [_x_ac_libunwind_dirs=no
+     with_libunwind=no]
+  )
+
+  LIBUNWIND_CFLAGS=""
+  LIBUNWIND_LDFLAGS=""
+  LIBUNWIND_LIBS=""
+
+  if test "x$_x_ac_libunwind_dirs" != xno ; then
+    AC_CACHE_CHECK(
+      [for libunwind installation],
+      [x_ac_cv_libunwind_dir],
+      [
+        for d in $_x_ac_libunwind_dirs; do
+          test -d "$d" || continue
+          test -d "$d/include" || continue
+          test -f "$d/include/libunwind.h" || continue
+          for bit in $_x_ac_libunwind_libs; do
+            test -d "$d/$bit" || continue
+            x_ac_cv_libunwind_dir=$d
+            break
+          done
+          test -n "$x_ac_cv_libunwind_dir" && break
+        done
+    ])
+
+    # if we failed to find libunwind, throw an error since the user asked for it
+    if test -z "$x_ac_cv_libunwind_dir"; then
+      AC_MSG_ERROR([unable to locate libunwind installation])
+    fi
+
+    # pick the library directory again, the cached check only records the prefix
+    for bit in $_x_ac_libunwind_libs; do
+      test -d "$x_ac_cv_libunwind_dir/$bit" && break
+    done
+
+    AC_DEFINE([HAVE_LIBUNWIND], [1], [Define if libunwind is available])
+    LIBUNWIND_CFLAGS="-I$x_ac_cv_libunwind_dir/include"
+    LIBUNWIND_LDFLAGS="-L$x_ac_cv_libunwind_dir/$bit"
+    LIBUNWIND_LIBS="-lunwind"
+  fi
+
+  # propogate the build flags to our makefiles
+  AC_SUBST(LIBUNWIND_CFLAGS)
+  AC_SUBST(LIBUNWIND_LDFLAGS)
+  AC_SUBST(LIBUNWIND_LIBS)
+])
@@ -6,7 +6,8 @@
 #    X_AC_MPILEAKS()
 #
 #  DESCRIPTION:
-#    Allows user to configure start and depth values for srun scripts.
+#    Allows user to configure start and depth values for srun scripts,
+#    and the default stack unwinder used by the library.
 #
 #  WARNINGS:
 #    This macro must be placed after AC_PROG_CC and before AC_PROG_LIBTOOL.
@@ -31,6 +32,27 @@ AC_DEFUN([X_AC_MPILEAKS], [
      with_stack_start_fortran=no]
   )
 
+  AC_ARG_WITH(
+    [unwinder],
+    AS_HELP_STRING(--with-unwinder=name,Specify default stack unwinder: callpath framepointer libunwind backtrace),
+    [_x_ac_unwinder="$withval"
+     with_unwinder=yes],
+    [_x_ac_unwinder=callpath
+     with_unwinder=no]
+  )
+  case "$_x_ac_unwinder" in
+    callpath|framepointer|backtrace) ;;
+    libunwind)
+      if test "x$LIBUNWIND_LIBS" = "x" ; then
+        AC_MSG_ERROR([--with-unwinder=libunwind requires --with-libunwind])
+      fi
+      ;;
+    *)
+      AC_MSG_ERROR([unknown stack unwinder: $_x_ac_unwinder])
+      ;;
+  esac
+  AC_DEFINE_UNQUOTED([MPILEAKS_UNWINDER], ["$_x_ac_unwinder"], [Default stack unwinder, override with MPILEAKS_UNWINDER])
+
   X_MPILEAKS_STACK_START_C=$_x_ac_stack_start_c
   X_MPILEAKS_STACK_START_FORTRAN=$_x_ac_stack_start_fortran
 
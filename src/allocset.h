@@ -0,0 +1,169 @@
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+#ifndef _ALLOCSET_H_
+#define _ALLOCSET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>                     // lower_bound, swap
+#include "pathtable.h"                   // path_id_t
+#include "slab.h"                        // SlabAllocator
+
+using namespace std;
+
+
+/* one allocation of a handle: the path it was allocated from and the
+ * generation of the allocation, which grows with every allocation */
+struct handle_alloc_t {
+  path_id_t path;
+  uint32_t generation;
+};
+
+/*
+ * Outstanding allocations of a handle, tracked by Handle2Set.
+ * A handle is nearly always allocated once before it is freed, so we
+ * keep one allocation inline and only spill to an array in the slabs
+ * if the handle value is allocated again while we still track it.
+ * The allocations are kept in the order of their generation, so a
+ * free is matched with the newest one, which is the allocation the
+ * application got the handle from.  Allocations can be walked with
+ * begin() and end(), oldest first.
+ */
+class AllocSet
+{
+ public:
+  typedef vector< handle_alloc_t, SlabAllocator<handle_alloc_t> > alloc_vector;
+  typedef const handle_alloc_t* const_iterator;
+
+  AllocSet() : count(0), many(NULL) {
+    one.path       = 0;
+    one.generation = 0;
+  }
+
+  AllocSet(const AllocSet& other) : count(0), many(NULL) {
+    *this = other;
+  }
+
+  ~AllocSet() {
+    slab_delete(many);
+  }
+
+  AllocSet& operator=(const AllocSet& other) {
+    if (this != &other) {
+      clear();
+      if (other.many != NULL) {
+        many = slab_new(*other.many);
+      }
+      one   = other.one;
+      count = other.count;
+    }
+    return *this;
+  }
+
+  size_t size() const {
+    return (many != NULL) ? many->size() : count;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  const_iterator begin() const {
+    if (many != NULL && !many->empty()) {
+      return &(*many)[0];
+    }
+    return &one;
+  }
+
+  const_iterator end() const {
+    return begin() + size();
+  }
+
+  /* the allocation with the highest generation */
+  const handle_alloc_t& newest() const {
+    return *(end() - 1);
+  }
+
+  /* add an allocation, its generation must be higher than those we hold */
+  void push(path_id_t path, uint32_t generation) {
+    if (many == NULL) {
+      if (count == 0) {
+        one.path       = path;
+        one.generation = generation;
+        count = 1;
+        return;
+      }
+
+      /* handle value reused, move to the array */
+      many = slab_new(alloc_vector());
+      many->push_back(one);
+      count = 0;
+    }
+
+    handle_alloc_t alloc;
+    alloc.path       = path;
+    alloc.generation = generation;
+    many->push_back(alloc);
+  }
+
+  /* drop the allocation of the given generation, if we hold it */
+  void retire(uint32_t generation) {
+    if (many == NULL) {
+      if (count == 1 && one.generation == generation) {
+        count = 0;
+      }
+      return;
+    }
+
+    /* allocations are sorted by generation */
+    alloc_vector::iterator it = lower_bound(many->begin(), many->end(), generation, older_than);
+    if (it != many->end() && it->generation == generation) {
+      many->erase(it);
+    }
+  }
+
+  /* bytes held in the slabs besides the set itself */
+  size_t spilled_bytes() const {
+    if (many == NULL) {
+      return 0;
+    }
+    return sizeof(alloc_vector) + many->capacity() * sizeof(handle_alloc_t);
+  }
+
+  void clear() {
+    slab_delete(many);
+    many  = NULL;
+    count = 0;
+  }
+
+  void swap(AllocSet& other) {
+    std::swap(one,   other.one);
+    std::swap(count, other.count);
+    std::swap(many,  other.many);
+  }
+
+ private:
+  static bool older_than(const handle_alloc_t& alloc, uint32_t generation) {
+    return alloc.generation < generation;
+  }
+
+  handle_alloc_t one;     /* the allocation, if count is 1 */
+  unsigned int count;     /* number of inline allocations, 0 or 1 */
+  alloc_vector* many;     /* allocations by generation, once we have spilled */
+};
+
+/* let containers move entries without copying the spilled allocations */
+inline void swap(AllocSet& a, AllocSet& b) {
+  a.swap(b);
+}
+
+
+#endif   // _ALLOCSET_H_
@@ -10,9 +10,12 @@
 #ifndef _CALLPATH2COUNT_H_
 #define _CALLPATH2COUNT_H_
 
-#include <map>
 #include <list>
 #include "CallpathRuntime.h"             // Callpath
+#include "pathtable.h"                   // path_id_t
+#include "handlemap.h"                   // HandleMap
+#include "evictfilter.h"                 // EvictFilter
+#include <stdint.h>
 
 using namespace std; 
 
@@ -24,10 +27,17 @@ extern list<Callpath2Count*> *h2cpc_objs;
 struct callpath_count { 
   Callpath path;
   int count;
+  int estimated;   /* part of count attributed to path by sampling */
+  uint64_t fingerprint;  /* of path, to order paths cheaply */
 }; 
 
 typedef struct callpath_count callpath_count_t; 
 
+/* table of path id to count, path ids are small integers that hash
+ * with a single multiply, so we use the same open addressing table
+ * as for handles rather than a tree */
+typedef HandleMap<path_id_t, int> path2count_t;
+
 
 /* 
  * Root, no-template class. 
@@ -48,7 +58,9 @@ class Callpath2Count
      before this instance. 
      Todo: there may be a race condition if instances of this class are 
      allocated in parallel. */ 
-  Callpath2Count() {
+  Callpath2Count(const char* tracker_name) :
+    name(tracker_name), evicted_objects(0), evicted_freed(0)
+  {
     if ( h2cpc_objs == NULL ) {
       h2cpc_objs = new list<Callpath2Count*>; 
     }
@@ -65,52 +77,40 @@ class Callpath2Count
   /******************************************************
    * Auxiliary functions to be used by derived classes
    ******************************************************/
-  void increase_count(map<Callpath,int> &callpath2count, Callpath path, int count) {
-    /* search for this path in our stacktrace-to-count map */
-    map<Callpath,int>::iterator it_path2count = callpath2count.find(path);
-    if ( it_path2count != callpath2count.end() ) {
-      /* found it, increment the count for this path */
-      it_path2count->second += count;
-    } else {
-      /* not found, so insert the path with the specified count */
-      callpath2count[path] = count;
-    } 
-  }
-  
-  void decrease_count(map<Callpath,int> &callpath2count, Callpath path, int count) {
-    /* now lookup path in path2count */
-    map<Callpath,int>::iterator it_path2count = callpath2count.find(path);
-    if (it_path2count != callpath2count.end()) {
-      if (it_path2count->second - count > 1) {
-	/* decrement the count for this path */
-	it_path2count->second -= count;
-      } else {
-        if (it_path2count->second - count < 0) {
-          /* we subtracted more than we ever added */
-          cerr << "mpileaks: Internal Error: Callpath2Count: "
-               << "negative count detected" 
-               << endl;
-        }
-
-	/* remove the entry from the path-to-count map */
-	callpath2count.erase(it_path2count);
-      }
-    } else {
-      cerr << "mpileaks: Internal Error: Callpath2Count: "
-	   << "found a path in handle2cpc, but no count found in callpath2count" 
-	   << endl;
-    }
+  void increase_count(path2count_t &callpath2count, path_id_t path, int count) {
+    /* find or insert this path with a count of 0 in a single probe,
+     * then add the specified count */
+    callpath2count[path] += count;
   }
   
-  int map2list(map<Callpath,int> &callpath2count, list<callpath_count_t> &lst) {
+  /* build the Callpath objects of our paths, we only do this
+   * when reporting so that capturing a path stays cheap */
+  int map2list(path2count_t &callpath2count, list<callpath_count_t> &lst) {
     int count = 0; 
-    callpath_count_t entry; 
-    map<Callpath,int>::iterator it;
     
+    /* ids that resolve to the same path must be reported as one
+     * entry, sum their counts by canonical id first, keeping track
+     * of how much of each count is only estimated */
+    HandleMap< path_id_t, pair<int,int> > canonical2count;
+    path2count_t::iterator it;
     for (it = callpath2count.begin(); it != callpath2count.end(); it++) {
-      entry.path  = it->first;
-      entry.count = it->second;
-      lst.push_back( entry );
+      path_id_t id = mpileaks_path_canonical(it->first);
+      pair<int,int>& counts = canonical2count[id];
+      counts.first += it->second;
+      if (mpileaks_path_is_estimated(it->first)) {
+        counts.second += it->second;
+      }
+    }
+
+    HandleMap< path_id_t, pair<int,int> >::iterator it_canon;
+    for (it_canon = canonical2count.begin(); it_canon != canonical2count.end(); it_canon++) {
+      /* build the entry in place rather than copying its Callpath */
+      lst.push_back( callpath_count_t() );
+      callpath_count_t& entry = lst.back();
+      entry.path  = mpileaks_path_resolve(it_canon->first);
+      entry.count = it_canon->second.first;
+      entry.estimated = it_canon->second.second;
+      entry.fingerprint = mpileaks_path_fingerprint(it_canon->first);
       count++; 
     }
     
@@ -128,10 +128,88 @@ class Callpath2Count
     return map2list( missing_alloc, lst ); 
   } 
 
+  /* objects like persistent requests that were started but never
+   * completed, reported by the callpath that allocated them */
+  virtual int get_started_leaks(list<callpath_count_t> &lst) {
+    return 0;
+  }
+
+  /* objects that were evicted to stay within MPILEAKS_MAX_MEMORY,
+   * reported by the callpath that allocated them, unless all of
+   * them have been freed since, we only know how many of them were
+   * freed and not from which callpath, so the counts are an upper
+   * bound of those still outstanding */
+  int get_evicted_leaks(list<callpath_count_t> &lst) {
+    if ( evicted_freed >= evicted_objects ) {
+      return 0;
+    }
+    return map2list( evicted, lst ); 
+  }
+
+  /* return the number of objects we evicted, and how many of
+   * those were freed after they were evicted, the latter may
+   * include a rare free of a handle we never saw allocated whose
+   * fingerprint matches that of an evicted handle */
+  void get_evicted_counts(unsigned long* objects, unsigned long* freed) {
+    *objects = evicted_objects;
+    *freed   = evicted_freed;
+  }
+
+  /* the capture level we are at, see mpileaks_capture */
+  virtual int get_capture() {
+    return 0;
+  }
+
+  /* the kind of objects we track, e.g., MPI_Comm */
+  const char* get_name() {
+    return name;
+  }
+
+  /* return the number of entries we hold, the bytes they take in
+   * the slabs, and the most bytes our tables ever took */
+  virtual void get_memory(size_t* entries, size_t* bytes, size_t* peak) {
+    *entries = 0;
+    *bytes   = missing_alloc.bytes() + evicted.bytes() + evicted_handles.bytes();
+    *peak    = missing_alloc.peak_bytes() + evicted.peak_bytes() + evicted_handles.bytes();
+  }
+
+  /* summarize the older entries by callpath into the evicted counts
+   * and drop them, see mpileaks_memory_check */
+  virtual void evict() {
+  }
+
+  /* bytes of the tables that evict can free */
+  virtual size_t evictable_bytes() {
+    return 0;
+  }
+
+  /* take back entries set aside for eviction before reporting */
+  virtual void merge_older() {
+  }
+
+  /* drop all entries, so their memory can be released with the slabs */
+  virtual void clear() {
+    missing_alloc.clear();
+    evicted.clear();
+    evicted_handles.clear();
+  }
+
   
  protected: 
+  const char* name; 
+
   /* map of callpath to count associated with no-allocate leaks */ 
-  map<Callpath, int> missing_alloc; 
+  path2count_t missing_alloc; 
+
+  /* map of callpath to count of objects we evicted, we can no
+   * longer tell which of these are freed later, only how many */
+  path2count_t evicted; 
+  unsigned long evicted_objects; 
+  unsigned long evicted_freed; 
+
+  /* the handles we evicted, so that only a free of one of them is
+   * counted in evicted_freed */
+  EvictFilter evicted_handles;
 }; 
 
 
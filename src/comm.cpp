@@ -19,9 +19,12 @@
  * instantiated. This is necessary since it depends on the type of 
  * handle used (e.g., MPI_File). 
  */ 
-static class MPI_Comm2CallpathSet : public Handle2Set<MPI_Comm>
+static class MPI_Comm2CallpathSet : public Handle2Set<MPI_Comm, MPI_Comm2CallpathSet>
 {
 public: 
+  MPI_Comm2CallpathSet() : Handle2Set<MPI_Comm, MPI_Comm2CallpathSet>("MPI_Comm") {
+  }
+
   bool is_handle_null(MPI_Comm handle) {
     return (handle == MPI_COMM_NULL) ? 1 : 0; 
   }
@@ -24,9 +24,12 @@
  * instantiated. This is necessary since it depends on the type of 
  * handle used (e.g., MPI_File). 
  */ 
-static class MPI_Datatype2CallpathSet : public Handle2Set<MPI_Datatype>
+static class MPI_Datatype2CallpathSet : public Handle2Set<MPI_Datatype, MPI_Datatype2CallpathSet>
 {
 public: 
+  MPI_Datatype2CallpathSet() : Handle2Set<MPI_Datatype, MPI_Datatype2CallpathSet>("MPI_Datatype") {
+  }
+
   bool is_handle_null(MPI_Datatype handle) {
     return (handle == MPI_DATATYPE_NULL) ? 1 : 0; 
   }
@@ -14,9 +14,12 @@
 /*
  * Track allocation and freeing of user-defined reduction ops.
  */ 
-static class MPI_Errhandler2CallpathSet : public Handle2Set<MPI_Errhandler>
+static class MPI_Errhandler2CallpathSet : public Handle2Set<MPI_Errhandler, MPI_Errhandler2CallpathSet>
 {
 public: 
+  MPI_Errhandler2CallpathSet() : Handle2Set<MPI_Errhandler, MPI_Errhandler2CallpathSet>("MPI_Errhandler") {
+  }
+
   bool is_handle_null(MPI_Errhandler handle) {
     return (handle == MPI_ERRHANDLER_NULL) ? 1 : 0; 
   }
@@ -0,0 +1,120 @@
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+#ifndef _EVICTFILTER_H_
+#define _EVICTFILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>                     // sort, merge, binary_search
+#include "slab.h"                        // SlabAllocator
+
+using namespace std;
+
+
+/*
+ * Compact record of the handles a tracker evicted, so that a free of
+ * an unknown handle is only charged to the evicted objects if that
+ * handle was evicted.  We keep a 32-bit fingerprint of each handle
+ * rather than the entry we dropped, 4 bytes per evicted object.
+ * Each eviction adds a sorted run of fingerprints, and a run is
+ * merged with the one before it unless that one is more than twice
+ * as large, so there are only a few runs to search however often
+ * we evict.  A handle we never evicted matches by chance with a
+ * probability of about the number of fingerprints over 2^32, a
+ * handle we evicted always matches.  Keys are the handle bits of
+ * HandleMap.
+ */
+class EvictFilter
+{
+ public:
+  typedef vector< uint32_t, SlabAllocator<uint32_t> > run_vector;
+
+  EvictFilter() {
+  }
+
+  /* start the run of an eviction of count handles */
+  void begin(size_t count) {
+    runs.push_back(run_vector());
+    runs.back().reserve(count);
+  }
+
+  /* add a handle to the run of the current eviction */
+  void insert(uint64_t key) {
+    runs.back().push_back(fingerprint(key));
+  }
+
+  /* sort the run of the current eviction and merge it into the
+   * runs before it while they are not much larger */
+  void end() {
+    sort(runs.back().begin(), runs.back().end());
+    while (runs.size() > 1 &&
+           runs[runs.size() - 2].size() <= 2 * runs.back().size())
+    {
+      run_vector& first  = runs[runs.size() - 2];
+      run_vector& second = runs.back();
+      run_vector merged(first.size() + second.size());
+      merge(first.begin(), first.end(), second.begin(), second.end(), merged.begin());
+      first.swap(merged);
+      runs.pop_back();
+    }
+  }
+
+  /* return true if we may have evicted the handle */
+  bool contains(uint64_t key) const {
+    uint32_t print = fingerprint(key);
+    size_t r;
+    for (r = 0; r < runs.size(); r++) {
+      if (binary_search(runs[r].begin(), runs[r].end(), print)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool empty() const {
+    return runs.empty();
+  }
+
+  /* bytes the runs take in the slabs */
+  size_t bytes() const {
+    size_t total = runs.capacity() * sizeof(run_vector);
+    size_t r;
+    for (r = 0; r < runs.size(); r++) {
+      total += runs[r].capacity() * sizeof(uint32_t);
+    }
+    return total;
+  }
+
+  void clear() {
+    run_list().swap(runs);
+  }
+
+ private:
+  typedef vector< run_vector, SlabAllocator<run_vector> > run_list;
+
+  /* the upper half of a 64-bit mix of key */
+  static uint32_t fingerprint(uint64_t key) {
+    uint64_t hash = key;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return (uint32_t) (hash >> 32);
+  }
+
+  /* sorted runs of fingerprints, each at least twice as large as
+   * the one after it, except for the last */
+  run_list runs;
+};
+
+
+#endif    // _EVICTFILTER_H_
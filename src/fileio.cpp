@@ -24,9 +24,12 @@
  * instantiated. This is necessary since it depends on the type of 
  * handle used (e.g., MPI_File). 
  */ 
-static class MPI_File2CallpathSet : public Handle2Set<MPI_File>
+static class MPI_File2CallpathSet : public Handle2Set<MPI_File, MPI_File2CallpathSet>
 {
 public: 
+  MPI_File2CallpathSet() : Handle2Set<MPI_File, MPI_File2CallpathSet>("MPI_File") {
+  }
+
   bool is_handle_null(MPI_File handle) {
     return (handle == MPI_FILE_NULL) ? 1 : 0; 
   }
@@ -0,0 +1,177 @@
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string>
+#include <map>
+
+#include "fingerprint.h"
+
+using namespace std;
+
+
+/* the crc32 instruction is part of SSE4.2, which we select per
+ * function so that the rest of mpileaks runs on any x86-64 */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MPILEAKS_HAVE_SSE42_CRC 1
+#endif
+
+/* CRC32C (Castagnoli) polynomial, bit reversed */
+#define CRC32C_POLY 0x82f63b78
+
+/* the second lane sees each word with its halves swapped, so the
+ * two lanes don't collide on the same inputs */
+#define FINGERPRINT_SWAP(word) (((word) << 32) | ((word) >> 32))
+
+
+/***********************************************************
+ *** Portable CRC32C
+ ***********************************************************/
+
+static uint32_t crc32c_table[256];
+static int crc32c_table_ready = 0;
+
+static void crc32c_table_init()
+{
+  uint32_t i;
+  for (i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    int bit;
+    for (bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : (crc >> 1);
+    }
+    crc32c_table[i] = crc;
+  }
+  crc32c_table_ready = 1;
+}
+
+/* feed the 8 bytes of a word into the crc, least significant first,
+ * which is what the crc32 instruction does on a little-endian word */
+static inline uint32_t crc32c_soft_u64(uint32_t crc, uint64_t word)
+{
+  int i;
+  for (i = 0; i < 8; i++) {
+    crc = (crc >> 8) ^ crc32c_table[(crc ^ (uint32_t) word) & 0xff];
+    word >>= 8;
+  }
+  return crc;
+}
+
+static uint64_t fingerprint_soft(const uintptr_t* words, size_t count)
+{
+  if (!crc32c_table_ready) {
+    crc32c_table_init();
+  }
+
+  uint32_t lo = 0xffffffff;
+  uint32_t hi = 0xffffffff;
+  size_t i;
+  for (i = 0; i < count; i++) {
+    uint64_t word = (uint64_t) words[i];
+    lo = crc32c_soft_u64(lo, word);
+    hi = crc32c_soft_u64(hi, FINGERPRINT_SWAP(word));
+  }
+  return ((uint64_t) hi << 32) | (uint64_t) lo;
+}
+
+
+/***********************************************************
+ *** SSE4.2 CRC32C
+ ***********************************************************/
+
+#ifdef MPILEAKS_HAVE_SSE42_CRC
+__attribute__((target("sse4.2")))
+static uint64_t fingerprint_sse42(const uintptr_t* words, size_t count)
+{
+  /* the two lanes are independent, so the processor can overlap them */
+  uint64_t lo = 0xffffffff;
+  uint64_t hi = 0xffffffff;
+  size_t i;
+  for (i = 0; i < count; i++) {
+    uint64_t word = (uint64_t) words[i];
+    lo = __builtin_ia32_crc32di(lo, word);
+    hi = __builtin_ia32_crc32di(hi, FINGERPRINT_SWAP(word));
+  }
+  return (hi << 32) | (lo & 0xffffffff);
+}
+#endif
+
+
+/***********************************************************
+ *** Fingerprints
+ ***********************************************************/
+
+/* 1 if we can use the crc32 instruction, -1 if not, 0 if unknown */
+static int fingerprint_hw = 0;
+
+uint64_t mpileaks_fingerprint(const uintptr_t* words, size_t count)
+{
+#ifdef MPILEAKS_HAVE_SSE42_CRC
+  if (fingerprint_hw == 0) {
+    fingerprint_hw = __builtin_cpu_supports("sse4.2") ? 1 : -1;
+  }
+  if (fingerprint_hw > 0) {
+    return fingerprint_sse42(words, count);
+  }
+#endif
+  return fingerprint_soft(words, count);
+}
+
+/* fingerprint of a module name, cached since the same few
+ * modules show up in nearly every path */
+static uint64_t fingerprint_module(const ModuleId& module)
+{
+  static map<ModuleId, uint64_t>* modules = NULL;
+  if (modules == NULL) {
+    modules = new map<ModuleId, uint64_t>;
+  }
+
+  map<ModuleId, uint64_t>::iterator it = modules->find(module);
+  if (it != modules->end()) {
+    return it->second;
+  }
+
+  /* pack the name into words, the last one padded with zeros */
+  const string& name = module.str();
+  size_t len = name.size();
+  size_t count = len / sizeof(uintptr_t) + 1;
+  uintptr_t* words = new uintptr_t[count];
+  words[count - 1] = 0;
+  name.copy((char*) words, len);
+
+  uint64_t fingerprint = mpileaks_fingerprint(words, count);
+  delete[] words;
+
+  (*modules)[module] = fingerprint;
+  return fingerprint;
+}
+
+uint64_t mpileaks_fingerprint_callpath(const Callpath& path)
+{
+  size_t size = path.size();
+  if (size == 0) {
+    return mpileaks_fingerprint(NULL, 0);
+  }
+
+  /* two words per frame: the module and the offset into it */
+  uintptr_t* words = new uintptr_t[2 * size];
+  size_t i;
+  for (i = 0; i < size; i++) {
+    const FrameId& frame = path[i];
+    words[2 * i]     = (uintptr_t) fingerprint_module(frame.module);
+    words[2 * i + 1] = frame.offset;
+  }
+
+  uint64_t fingerprint = mpileaks_fingerprint(words, 2 * size);
+  delete[] words;
+  return fingerprint;
+}
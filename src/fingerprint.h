@@ -0,0 +1,34 @@
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+#ifndef _FINGERPRINT_H_
+#define _FINGERPRINT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "CallpathRuntime.h"             // Callpath
+
+
+/* Fingerprints are 64-bit hashes built from two CRC32C lanes, using
+ * the SSE4.2 crc32 instruction when the processor has it and a table
+ * driven implementation otherwise.  Both give the same values.  They
+ * are used to order and compare paths cheaply, equal paths always
+ * have equal fingerprints, but equal fingerprints must still be
+ * checked by comparing the paths themselves. */
+
+/* return the fingerprint of an array of words */
+uint64_t mpileaks_fingerprint(const uintptr_t* words, size_t count);
+
+/* return the fingerprint of the (module, offset) frames of a path,
+ * this only depends on module names, so a path gets the same
+ * fingerprint on every process */
+uint64_t mpileaks_fingerprint_callpath(const Callpath& path);
+
+
+#endif   // _FINGERPRINT_H_
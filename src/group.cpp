@@ -19,9 +19,12 @@
  * instantiated. This is necessary since it depends on the type of 
  * handle used (e.g., MPI_File). 
  */ 
-static class MPI_Group2CallpathSet : public Handle2Set<MPI_Group>
+static class MPI_Group2CallpathSet : public Handle2Set<MPI_Group, MPI_Group2CallpathSet>
 {
 public: 
+  MPI_Group2CallpathSet() : Handle2Set<MPI_Group, MPI_Group2CallpathSet>("MPI_Group") {
+  }
+
   bool is_handle_null(MPI_Group handle) {
     return (handle == MPI_GROUP_NULL || handle == MPI_GROUP_EMPTY) ? 1 : 0; 
   }
@@ -0,0 +1,271 @@
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+#ifndef _HANDLEMAP_H_
+#define _HANDLEMAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <utility>                       // pair, swap
+#include "slab.h"                        // SlabAllocator
+
+using namespace std;
+
+
+/*
+ * Hash the bits of a handle.  Depending on the MPI library, handles
+ * are either integers (e.g., MPICH) or pointers to library objects
+ * (e.g., Open MPI), and memory handles are plain pointers.  Objects
+ * are at least 8-byte aligned, so we drop the low bits of pointers
+ * which would otherwise always be zero.
+ */
+template<class T> inline uint64_t handle_bits(T handle) {
+  return (uint64_t) handle;
+}
+
+template<class T> inline uint64_t handle_bits(T* handle) {
+  return (uint64_t) ((uintptr_t) handle >> 3);
+}
+
+
+/*
+ * Map of handle to callpath container used by Handle2CPC, also used
+ * for the tables of path id to count of Callpath2Count.
+ * Handles are stored in a flat array with open addressing and linear
+ * probing, so that a lookup is a multiply and usually a single cache
+ * miss rather than a walk down a tree with one heap node per handle.
+ * Entries are pairs, like those of std::map, and the subset of the
+ * std::map interface used by the trackers is provided.  Inserting or
+ * erasing may move other entries and so invalidates iterators.  The
+ * slots are allocated from the mpileaks slabs, see slab.h.
+ */
+template<class T, class U> class HandleMap
+{
+ public:
+  typedef pair<T,U> value_type;
+
+  class iterator
+  {
+   public:
+    iterator() : owner(NULL), index(0) {
+    }
+
+    iterator(HandleMap* m, size_t i) : owner(m), index(i) {
+      skip();
+    }
+
+    value_type& operator*() const {
+      return owner->slots[index];
+    }
+
+    value_type* operator->() const {
+      return &owner->slots[index];
+    }
+
+    iterator& operator++() {
+      index++;
+      skip();
+      return *this;
+    }
+
+    iterator operator++(int) {
+      iterator prev = *this;
+      ++(*this);
+      return prev;
+    }
+
+    bool operator==(const iterator& other) const {
+      return index == other.index;
+    }
+
+    bool operator!=(const iterator& other) const {
+      return index != other.index;
+    }
+
+   private:
+    /* move forward to the next used slot */
+    void skip() {
+      while (index < owner->used.size() && !owner->used[index]) {
+        index++;
+      }
+    }
+
+    HandleMap* owner;
+    size_t index;
+
+    friend class HandleMap;
+  };
+
+
+  HandleMap() : count(0), shift(64), peak(0) {
+  }
+
+  iterator begin() {
+    return iterator(this, 0);
+  }
+
+  iterator end() {
+    return iterator(this, used.size());
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  bool empty() const {
+    return count == 0;
+  }
+
+  /* bytes taken by the slots */
+  size_t bytes() const {
+    return slots.capacity() * sizeof(value_type) + used.capacity();
+  }
+
+  /* most bytes the slots ever took, including while we grow */
+  size_t peak_bytes() const {
+    return peak;
+  }
+
+  iterator find(const T& handle) {
+    if (count > 0) {
+      size_t mask = used.size() - 1;
+      size_t i = home(handle);
+      while (used[i]) {
+        if (slots[i].first == handle) {
+          return iterator(this, i);
+        }
+        i = (i + 1) & mask;
+      }
+    }
+    return end();
+  }
+
+  /* return the value of handle, inserting a default one if needed */
+  U& operator[](const T& handle) {
+    /* grow once we are 3/4 full to keep probe sequences short */
+    if ((count + 1) * 4 > used.size() * 3) {
+      grow();
+    }
+
+    size_t mask = used.size() - 1;
+    size_t i = home(handle);
+    while (used[i]) {
+      if (slots[i].first == handle) {
+        return slots[i].second;
+      }
+      i = (i + 1) & mask;
+    }
+
+    used[i] = 1;
+    slots[i].first = handle;
+    count++;
+    return slots[i].second;
+  }
+
+  /* exchange the entries of two maps without moving any of them */
+  void swap(HandleMap& other) {
+    slots.swap(other.slots);
+    used.swap(other.used);
+    std::swap(count, other.count);
+    std::swap(shift, other.shift);
+    std::swap(peak,  other.peak);
+  }
+
+  /* drop all entries and give the slots back to the slabs */
+  void clear() {
+    slot_vector().swap(slots);
+    used_vector().swap(used);
+    count = 0;
+    shift = 64;
+  }
+
+  void erase(iterator it) {
+    /* release whatever the value holds on to */
+    size_t i = it.index;
+    slots[i].second = U();
+    used[i] = 0;
+    count--;
+
+    /* shift later entries of the probe sequence back into the hole,
+     * so that lookups can stop at the first empty slot */
+    size_t mask = used.size() - 1;
+    size_t j = i;
+    while (1) {
+      j = (j + 1) & mask;
+      if (!used[j]) {
+        break;
+      }
+
+      /* the entry at j can move into i only if its home slot
+       * does not lie cyclically within (i, j] */
+      size_t k = home(slots[j].first);
+      bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+      if (!stays) {
+        std::swap(slots[i], slots[j]);
+        used[i] = 1;
+        used[j] = 0;
+        i = j;
+      }
+    }
+  }
+
+ private:
+  /* slot at which handle would ideally be stored */
+  size_t home(const T& handle) const {
+    /* multiplicative hashing, use the upper bits of the product */
+    uint64_t hash = handle_bits(handle) * 0x9e3779b97f4a7c15ULL;
+    return (size_t) (hash >> shift);
+  }
+
+  /* double the number of slots and reinsert all entries */
+  void grow() {
+    size_t size = used.empty() ? 16 : used.size() * 2;
+
+    slot_vector old_slots(size);
+    used_vector old_used(size, 0);
+    old_slots.swap(slots);
+    old_used.swap(used);
+
+    size_t both = bytes() + old_slots.capacity() * sizeof(value_type) + old_used.capacity();
+    if (both > peak) {
+      peak = both;
+    }
+
+    shift = 64;
+    while (((size_t) 1 << (64 - shift)) < size) {
+      shift--;
+    }
+
+    size_t mask = size - 1;
+    size_t i;
+    for (i = 0; i < old_used.size(); i++) {
+      if (old_used[i]) {
+        size_t j = home(old_slots[i].first);
+        while (used[j]) {
+          j = (j + 1) & mask;
+        }
+        std::swap(slots[j], old_slots[i]);
+        used[j] = 1;
+      }
+    }
+  }
+
+  typedef vector< value_type, SlabAllocator<value_type> > slot_vector;
+  typedef vector< char, SlabAllocator<char> > used_vector;
+
+  slot_vector slots;
+  used_vector used;
+  size_t count;   /* number of used slots */
+  int shift;      /* 64 - log2(number of slots) */
+  size_t peak;    /* see peak_bytes */
+};
+
+
+#endif   // _HANDLEMAP_H_
@@ -14,9 +14,12 @@
 /*
  * This class tracks info objects.
  */ 
-static class MPI_Info2CallpathSet : public Handle2Set<MPI_Info>
+static class MPI_Info2CallpathSet : public Handle2Set<MPI_Info, MPI_Info2CallpathSet>
 {
 public: 
+  MPI_Info2CallpathSet() : Handle2Set<MPI_Info, MPI_Info2CallpathSet>("MPI_Info") {
+  }
+
   bool is_handle_null(MPI_Info handle) {
     return (handle == MPI_INFO_NULL) ? 1 : 0; 
   }
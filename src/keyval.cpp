@@ -15,13 +15,16 @@
  * Track allocation and freeing of attributes.  We track attributes
  * for comms,windows, and files separately, but all within this file.
  */ 
-static class MPI_Keyval2CallpathSet : public Handle2Set<int>
+static class MPI_Keyval2CallpathSet : public Handle2Set<int, MPI_Keyval2CallpathSet>
 {
 public: 
+  MPI_Keyval2CallpathSet(const char* name) : Handle2Set<int, MPI_Keyval2CallpathSet>(name) {
+  }
+
   bool is_handle_null(int handle) {
     return (handle == MPI_KEYVAL_INVALID) ? 1 : 0; 
   }
-} Commkeyval2Callpath, Winkeyval2Callpath, Typekeyval2Callpath; 
+} Commkeyval2Callpath("comm keyval"), Winkeyval2Callpath("win keyval"), Typekeyval2Callpath("type keyval"); 
 
 
 /************************************************
@@ -20,9 +20,12 @@
 /*
  * This class tracks memory allocated and freed via calls to MPI.
  */ 
-static class MPI_Mem2Callpath : public Handle2Callpath<void*>
+static class MPI_Mem2Callpath : public Handle2Callpath<void*, MPI_Mem2Callpath>
 {
 public: 
+  MPI_Mem2Callpath() : Handle2Callpath<void*, MPI_Mem2Callpath>("MPI_Alloc_mem") {
+  }
+
   bool is_handle_null(void* handle) {
     /* memory is always valid, an error is thrown at allocation if invalid
      * and the "handle" is not changed to NULL on free */
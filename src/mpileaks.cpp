@@ -7,15 +7,25 @@
  * For details, see https://github.com/hpc/mpileaks
  * Please also read this file: LICENSE.TXT. */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <iostream>
 #include <map> 
 #include <list>
+#include <vector>
 
 #include "mpi.h"
 #include "CallpathRuntime.h"                // Callpath
 #include "Translator.h"
 #include "FrameInfo.h"
 #include "callpath2count.h"                   // Callpath2Count, callpath_count_t
+#include "mpileaks.h"                         // mpileaks_capture
+#include "unwind.h"                           // mpileaks_unwind_lookup
+#include "pathtable.h"                        // mpileaks_path_table_clear
+#include "fingerprint.h"                      // mpileaks_fingerprint_callpath
+#include "slab.h"                             // mpileaks_slab_release
 
 
 using namespace std;
@@ -35,6 +45,27 @@ int depth = -1;
  * for example Fortran MPI wrappers that invoke C calls */
 int chop = 2;
 
+/* stack unwinder used to capture call paths, see unwind.h */
+int unwinder = MPILEAKS_UNWIND_CALLPATH;
+
+/* whether to look up call paths in the call-site cache, see pathtable.h */
+int callsite_cache = 0;
+
+/* capture the path of one in sample_rate allocations per call site,
+ * 1 captures all of them */
+int sample_rate = 1;
+
+/* current capture level, see mpileaks_capture in mpileaks.h */
+int capture = 0;
+
+/* step down the capture level when our overhead exceeds this
+ * percentage of wall time, 0 disables throttling */
+double max_overhead = 0.0;
+
+/* evict the entries of our trackers when they hold more than
+ * this many bytes, 0 means there is no limit */
+size_t max_memory = 0;
+
 CallpathRuntime *runtime = NULL;
 
 /* h2cpc_objs stores pointers to all objects derived from Callpath2Count.
@@ -51,23 +82,139 @@ list<Callpath2Count*> *h2cpc_objs = NULL;
 static Translator trans; 
 static int myrank, np; 
 
+/* add the memory mpileaks took to the report, MPILEAKS_VERBOSE */
+static int verbose = 0;
+
+
+/***********************************************************
+ *** Throttle our overhead
+ ***********************************************************/
+
+/* wall time at which trackers start to measure their overhead */
+static double overhead_start = 0.0;
+
+/* wall time we measure over before deciding to step down */
+#define OVERHEAD_MIN_WINDOW 1.0
+
+static const char* capture_names[] = {
+  "full call paths",
+  "shallow call paths",
+  "call sites only",
+  "counts only"
+};
+
+double mpileaks_overhead_begin()
+{
+  return PMPI_Wtime();
+}
+
+void mpileaks_overhead_end(mpileaks_throttle_t* throttle, double start)
+{
+  double now = PMPI_Wtime();
+  if (throttle->calls == 0) {
+    throttle->window = overhead_start;
+  }
+  throttle->time += now - start;
+  throttle->calls++;
+
+  /* reading the clock is cheap, but don't compare on every call */
+  if ((throttle->calls & 0x3f) != 0 || throttle->capture == MPILEAKS_CAPTURE_COUNTS) {
+    return;
+  }
+
+  double wall = now - throttle->window;
+  if (wall > OVERHEAD_MIN_WINDOW && throttle->time > wall * max_overhead / 100.0) {
+    /* step down one level and measure the new level on its own */
+    throttle->capture++;
+    throttle->time   = 0.0;
+    throttle->window = now;
+  }
+}
+
+
+/***********************************************************
+ *** Bound our memory
+ ***********************************************************/
+
+/* bytes of the tracker tables left after the last eviction */
+static size_t evict_mark = 0;
+
+static size_t mpileaks_evictable_bytes()
+{
+  size_t bytes = 0;
+  list<Callpath2Count*>::iterator it;
+  for (it = h2cpc_objs->begin(); it != h2cpc_objs->end(); it++) {
+    bytes += (*it)->evictable_bytes();
+  }
+  return bytes;
+}
+
+void mpileaks_memory_check()
+{
+  /* the tables we can evict are part of the slabs, so the cheap
+   * test tells us most of the time that we are within bounds */
+  if (mpileaks_slab_in_use() <= max_memory) {
+    return;
+  }
+
+  /* only count what evict can free, the counts by callpath, the
+   * fingerprints of evicted handles and the persistent objects
+   * stay, and once those alone take more than max_memory, evicting
+   * on every call would just stop tracking, so wait until the
+   * tables have grown by half the budget again */
+  size_t bytes = mpileaks_evictable_bytes();
+  if (bytes <= max_memory || bytes <= evict_mark + max_memory / 2) {
+    return;
+  }
+
+  /* each tracker evicts the entries it set aside last time, which
+   * are older than any it tracks now, and sets aside the rest */
+  list<Callpath2Count*>::iterator it;
+  for (it = h2cpc_objs->begin(); it != h2cpc_objs->end(); it++) {
+    (*it)->evict();
+  }
+  evict_mark = mpileaks_evictable_bytes();
+}
+
+/* parse a number of bytes with an optional K, M, or G suffix */
+static size_t mpileaks_parse_bytes(const char* value)
+{
+  char* end;
+  unsigned long long bytes = strtoull(value, &end, 10);
+  if (*end == 'k' || *end == 'K') {
+    bytes <<= 10;
+  } else if (*end == 'm' || *end == 'M') {
+    bytes <<= 20;
+  } else if (*end == 'g' || *end == 'G') {
+    bytes <<= 30;
+  }
+  return (size_t) bytes;
+}
+
 
 /***********************************************************
  *** Functions to gather and print outstanding stack traces 
  ***********************************************************/
 
-static void mpileaks_print_path(Callpath path, int count)
+static void mpileaks_print_path(const Callpath& path, int count, int estimated)
 {
   int i, size = path.size();
 
   cout << "Count: " << count; 
+  if (estimated > 0) {
+    cout << " (" << estimated << " estimated)";
+  }
   if (size > 1) {
     cout << endl;
   } else {
     cout << "  ::";
   }
+  if (size == 0) {
+    /* counted without capturing the path, see mpileaks_capture */
+    cout << "  (no call path)" << endl;
+  }
   for (i = 0; i < size; i++) {
-    FrameId frame = path[i];
+    const FrameId& frame = path[i];
     FrameInfo info = trans.translate(frame);
     cout << "  " << info << endl;
   }
@@ -77,49 +224,52 @@ static void mpileaks_print_path(Callpath path, int count)
 }
 
 
-/* sort callpath_count items by path */
-static bool compare_callpaths(callpath_count_t first, callpath_count_t second)
+/* sort callpath_count items by path, this order only has to be the
+ * same on all processes, so we compare fingerprints and only compare
+ * frames if two different paths happen to have the same fingerprint,
+ * the sort calls this a lot, so don't copy the items */
+static bool compare_callpaths(const callpath_count_t& first, const callpath_count_t& second)
 {
+  if (first.fingerprint != second.fingerprint) {
+    return (first.fingerprint < second.fingerprint);
+  }
+  if (first.path == second.path) {
+    return false;
+  }
+
   callpath_path_lt lt;
-  Callpath first_path  = first.path;
-  Callpath second_path = second.path;
-  return lt(first_path, second_path);
+  return lt(first.path, second.path);
 }
 
 
 /* sort callpath_count items by count (descending), then path (ascending) */
-static bool compare_counts(callpath_count_t first, callpath_count_t second)
+static bool compare_counts(const callpath_count_t& first, const callpath_count_t& second)
 {
   /* sort by counts in reverse order */
-  int first_count  = first.count;
-  int second_count = second.count;
-  if (first_count > second_count) {
+  if (first.count > second.count) {
     return true;
-  } else if (first_count < second_count) {
+  } else if (first.count < second.count) {
     return false;
   }
 
   /* sort by callpath in ascending order */
   callpath_path_lt lt;
-  Callpath first_path  = first.path;
-  Callpath second_path = second.path;
-  return lt(first_path, second_path);
+  return lt(first.path, second.path);
 }
 
 
 /* pack and send a list of callpath_count items to specified destination process */
-static void list_send(list<callpath_count_t>& path_list, int dest, MPI_Comm comm)
+static void list_send(const list<callpath_count_t>& path_list, int dest, MPI_Comm comm)
 {
-  list<callpath_count_t>::iterator it_list;
+  list<callpath_count_t>::const_iterator it_list;
 
   /* get size of buffer to pack list into */
   int pack_size = 0;
   pack_size += pmpi_packed_size(1, MPI_INT, comm);
   pack_size += ModuleId::packed_size_id_map(comm);
   for (it_list = path_list.begin(); it_list != path_list.end(); it_list++) {
-    Callpath path = (*it_list).path;
-    pack_size += path.packed_size(comm);
-    pack_size += pmpi_packed_size(1, MPI_INT, comm);
+    pack_size += (*it_list).path.packed_size(comm);
+    pack_size += pmpi_packed_size(2, MPI_INT, comm);
   }
 
   /* Allocate memory */
@@ -140,8 +290,10 @@ static void list_send(list<callpath_count_t>& path_list, int dest, MPI_Comm comm
     ModuleId::pack_id_map(buffer, pack_size, &position, comm);
     for (it_list = path_list.begin(); it_list != path_list.end(); it_list++) {
       (*it_list).path.pack(buffer, pack_size, &position, comm);
-      int count = (*it_list).count;
-      PMPI_Pack(&count, 1, MPI_INT, buffer, pack_size, &position, comm);
+      int counts[2];
+      counts[0] = (*it_list).count;
+      counts[1] = (*it_list).estimated;
+      PMPI_Pack(counts, 2, MPI_INT, buffer, pack_size, &position, comm);
     }
   }
 
@@ -187,18 +339,18 @@ static void list_recv(list<callpath_count_t>& path_list, int src, MPI_Comm comm)
     ModuleId::id_map modules;
     ModuleId::unpack_id_map(buffer, pack_size, &position, modules, comm);
     while (size > 0) {
-      /* unpack the path */
-      Callpath path = Callpath::unpack(modules, buffer, pack_size, &position, comm);
-
-      /* unpack the count */
-      int count;
-      PMPI_Unpack(buffer, pack_size, &position, &count, 1, MPI_INT, comm);
-
-      /* insert an item for this callpath/count into our list */
-      callpath_count_t elem;
-      elem.path  = path;
-      elem.count = count;
-      path_list.push_back(elem);
+      /* insert an item for this callpath/count into our list,
+       * and unpack the path right into it */
+      path_list.push_back( callpath_count_t() );
+      callpath_count_t& elem = path_list.back();
+      elem.path = Callpath::unpack(modules, buffer, pack_size, &position, comm);
+      elem.fingerprint = mpileaks_fingerprint_callpath(elem.path);
+
+      /* unpack the count and the part of it that is estimated */
+      int counts[2];
+      PMPI_Unpack(buffer, pack_size, &position, counts, 2, MPI_INT, comm);
+      elem.count = counts[0];
+      elem.estimated = counts[1];
 
       /* decrement out count by one */
       size--;
@@ -214,7 +366,8 @@ static void list_recv(list<callpath_count_t>& path_list, int src, MPI_Comm comm)
 
 
 /* merge list2 into list1, add new entries to list1 where needed, add count
- * fields where there is a match */
+ * fields where there is a match, new entries are moved from list2 to list1
+ * rather than copied, so list2 only keeps the matched entries */
 static void list_merge(list<callpath_count_t>& list1, list<callpath_count_t>& list2)
 {
   /* start with the first element in each list */
@@ -224,30 +377,26 @@ static void list_merge(list<callpath_count_t>& list1, list<callpath_count_t>& li
   while (it_list1 != list1.end() && it_list2 != list2.end()) {
     /* get next element from each list, since the lists are sorted in ascending order,
      * this element will be the smallest from each list */
-    callpath_count_t item1 = (*it_list1);
-    callpath_count_t item2 = (*it_list2);
+    const callpath_count_t& item1 = (*it_list1);
+    const callpath_count_t& item2 = (*it_list2);
     
     if (compare_callpaths(item2, item1)) {
-      /* list2 has smaller element, insert from list2 and move to next element in list2 */
-      list1.insert(it_list1, item2);
-      it_list2++;
+      /* list2 has smaller element, move it to list1 and move to next element in list2 */
+      list1.splice(it_list1, list2, it_list2++);
     } else if (compare_callpaths(item1, item2)) {
       /* list1 has smaller element, just move to next element in list1 */
       it_list1++;
     } else {
       /* both lists have the same element, add the counts and move to the next element in each list */
       (*it_list1).count += (*it_list2).count;
+      (*it_list1).estimated += (*it_list2).estimated;
       it_list1++;
       it_list2++;
     }
   }
 
-  /* insert any remaining items in list2 to the end of list1 */
-  while (it_list2 != list2.end()) {
-    callpath_count_t item2 = (*it_list2);
-    list1.insert(it_list1, item2);
-    it_list2++;
-  }
+  /* move any remaining items in list2 to the end of list1 */
+  list1.splice(it_list1, list2, it_list2, list2.end());
 }
 
 
@@ -291,9 +440,7 @@ static void mpileaks_reduce_callpaths(list<callpath_count_t> &path_list, const c
       /* now print each callpath with its count */
       list<callpath_count_t>::iterator it_list;
       for (it_list = path_list.begin(); it_list != path_list.end(); it_list++) {
-	Callpath path = (*it_list).path;
-	int count = (*it_list).count;
-	mpileaks_print_path(path, count);
+	mpileaks_print_path((*it_list).path, (*it_list).count, (*it_list).estimated);
       }
       cout << "----------------------------------------------------------------------" << endl;
       cout << "END SECTION: " << name << endl;
@@ -303,6 +450,105 @@ static void mpileaks_reduce_callpaths(list<callpath_count_t> &path_list, const c
 }
 
 
+/* combine (min, max, sum) triples elementwise, see mpileaks_report_memory */
+static void mpileaks_memory_op(void* invec, void* inoutvec, int* len, MPI_Datatype* type)
+{
+  const unsigned long long* in = (const unsigned long long*) invec;
+  unsigned long long* inout = (unsigned long long*) inoutvec;
+  int i;
+  for (i = 0; i < 3 * (*len); i += 3) {
+    if (in[i] < inout[i]) {
+      inout[i] = in[i];
+    }
+    if (in[i + 1] > inout[i + 1]) {
+      inout[i + 1] = in[i + 1];
+    }
+    inout[i + 2] += in[i + 2];
+  }
+}
+
+/* print a (min, max, sum) triple */
+static void mpileaks_print_triple(const unsigned long long* triple)
+{
+  cout << triple[0] << " / " << triple[1] << " / " << triple[2];
+}
+
+/* print the memory of each tracker and of the path table as the
+ * minimum, maximum, and sum over all processes, and the most memory
+ * they held at any one time, the trackers are the same and in the
+ * same order on all processes, so we reduce all values at once */
+static void mpileaks_report_memory()
+{
+  list<Callpath2Count*>::iterator it;
+
+  /* entries, bytes, and peak bytes of each tracker, then paths and
+   * bytes of the path table and the peak of the slabs */
+  int ntrackers = (int) h2cpc_objs->size();
+  int nvalues = 3 * ntrackers + 3;
+  vector<unsigned long long> values(nvalues);
+  int v = 0;
+  for ( it = h2cpc_objs->begin(); it != h2cpc_objs->end(); it++ ) { 
+    size_t entries, bytes, peak;
+    (*it)->get_memory(&entries, &bytes, &peak);
+    values[v++] = (unsigned long long) entries;
+    values[v++] = (unsigned long long) bytes;
+    values[v++] = (unsigned long long) peak;
+  }
+  size_t paths, path_bytes;
+  mpileaks_path_table_memory(&paths, &path_bytes);
+  values[v++] = (unsigned long long) paths;
+  values[v++] = (unsigned long long) path_bytes;
+  size_t current, peak;
+  mpileaks_slab_footprint(&current, &peak);
+  values[v++] = (unsigned long long) peak;
+
+  /* each value starts out as its own min, max, and sum */
+  vector<unsigned long long> triples(3 * nvalues), totals(3 * nvalues);
+  for (v = 0; v < nvalues; v++) {
+    triples[3 * v + 0] = values[v];
+    triples[3 * v + 1] = values[v];
+    triples[3 * v + 2] = values[v];
+  }
+
+  MPI_Datatype triple_type;
+  MPI_Op triple_op;
+  PMPI_Type_contiguous(3, MPI_UNSIGNED_LONG_LONG, &triple_type);
+  PMPI_Type_commit(&triple_type);
+  PMPI_Op_create(mpileaks_memory_op, 1, &triple_op);
+  PMPI_Reduce(&triples[0], &totals[0], nvalues, triple_type, triple_op, 0, MPI_COMM_WORLD);
+  PMPI_Op_free(&triple_op);
+  PMPI_Type_free(&triple_type);
+
+  if (myrank != 0) {
+    return;
+  }
+
+  cout << "mpileaks: tracker memory, min / max / sum over processes:" << endl;
+  const unsigned long long* triple = &totals[0];
+  for ( it = h2cpc_objs->begin(); it != h2cpc_objs->end(); it++, triple += 9 ) { 
+    /* skip trackers that were never used */
+    if (triple[8] == 0) {
+      continue;
+    }
+    cout << "mpileaks:   " << (*it)->get_name() << ": ";
+    mpileaks_print_triple(&triple[0]);
+    cout << " entries, ";
+    mpileaks_print_triple(&triple[3]);
+    cout << " bytes, peak ";
+    mpileaks_print_triple(&triple[6]);
+    cout << " bytes" << endl;
+  }
+  cout << "mpileaks:   call paths: ";
+  mpileaks_print_triple(&triple[0]);
+  cout << " paths, ";
+  mpileaks_print_triple(&triple[3]);
+  cout << " bytes" << endl;
+
+  cout << "mpileaks: tracker memory peak: " << triple[7] << " bytes max per process, "
+       << triple[8] << " bytes total" << endl;
+}
+
+
 /* cycle through and print each stack trace for which there is an outstanding request */
 static void mpileaks_dump_outstanding()
 {
@@ -315,6 +561,12 @@ static void mpileaks_dump_outstanding()
     cout << "----------------------------------------------------------------------" << endl;
   }
 
+  /* take back the entries the trackers set aside for eviction */
+  for ( it = h2cpc_objs->begin(); it != h2cpc_objs->end(); it++ ) { 
+    (*it)->merge_older(); 
+  }
+  evict_mark = 0;
+
   /* Gather all (callpath,count) pairs from all Handle2CPC objects
      and store into a list. 
      'mpileaks_reduce_callpaths' can be called such that the user
@@ -337,7 +589,94 @@ static void mpileaks_dump_outstanding()
     (*it)->get_missing_alloc_leaks( path_list ); 
   }
   mpileaks_reduce_callpaths(path_list, "ALLOCATION CALL UNKNOWN");
-  
+
+  path_list.clear(); 
+  for ( it = h2cpc_objs->begin(); it != h2cpc_objs->end(); it++ ) { 
+    (*it)->get_started_leaks( path_list ); 
+  }
+  mpileaks_reduce_callpaths(path_list, "STARTED BUT NOT COMPLETED");
+
+  path_list.clear(); 
+  for ( it = h2cpc_objs->begin(); it != h2cpc_objs->end(); it++ ) { 
+    (*it)->get_evicted_leaks( path_list ); 
+  }
+  mpileaks_reduce_callpaths(path_list, "EVICTED OBJECTS (UPPER BOUND)");
+
+  /* the counts above include evicted objects that were freed later,
+   * we can only tell how many of them are still outstanding, since
+   * a free may match the fingerprint of an evicted handle by
+   * chance, that is at least the number we print */
+  if (max_memory > 0) {
+    unsigned long long counts[2], totals[2];
+    counts[0] = 0;
+    counts[1] = 0;
+    for ( it = h2cpc_objs->begin(); it != h2cpc_objs->end(); it++ ) { 
+      unsigned long objects, freed;
+      (*it)->get_evicted_counts(&objects, &freed);
+      counts[0] += objects;
+      counts[1] += freed;
+    }
+    PMPI_Reduce(counts, totals, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (myrank == 0 && totals[0] > 0) {
+      cout << "mpileaks: at least " << (totals[0] - totals[1]) << " of the " << totals[0]
+           << " EVICTED OBJECTS are still outstanding, the other " << totals[1]
+           << " were freed after they were evicted" << endl;
+    }
+  }
+
+  /* let the user know whether we had to cut back on call paths,
+   * either because the path table ran out of ids, see pathtable.cpp,
+   * or because of the overhead of a tracker, the trackers are the
+   * same and in the same order on all processes */
+  {
+    int ntrackers = (int) h2cpc_objs->size();
+    vector<int> levels(ntrackers + 1), levels_max(ntrackers + 1);
+    vector<int> counts(ntrackers + 1), totals(ntrackers + 1);
+    levels[0] = capture;
+    counts[0] = (capture > MPILEAKS_CAPTURE_FULL) ? 1 : 0;
+    int t = 1;
+    for ( it = h2cpc_objs->begin(); it != h2cpc_objs->end(); it++, t++ ) { 
+      levels[t] = (*it)->get_capture();
+      counts[t] = (levels[t] > capture) ? 1 : 0;
+    }
+    PMPI_Reduce(&levels[0], &levels_max[0], ntrackers + 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(&counts[0], &totals[0], ntrackers + 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (myrank == 0) {
+      if (totals[0] > 0) {
+        cout << "mpileaks: too many distinct call paths on " << totals[0]
+             << " processes, later objects were counted without their call paths" << endl;
+      }
+      t = 1;
+      for ( it = h2cpc_objs->begin(); it != h2cpc_objs->end(); it++, t++ ) { 
+        if (totals[t] > 0) {
+          cout << "mpileaks: overhead of " << (*it)->get_name() << " exceeded MPILEAKS_MAX_OVERHEAD on "
+               << totals[t] << " processes, captured down to " << capture_names[levels_max[t]] << endl;
+        }
+      }
+    }
+  }
+
+  /* sum up the hits and misses of the call-site cache */
+  if (callsite_cache) {
+    uint64_t hits, misses;
+    mpileaks_path_cache_stats(&hits, &misses);
+    unsigned long long counts[2], totals[2];
+    counts[0] = (unsigned long long) hits;
+    counts[1] = (unsigned long long) misses;
+    PMPI_Reduce(counts, totals, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (myrank == 0) {
+      cout << "mpileaks: call-site cache: " << totals[0] << " hits, "
+           << totals[1] << " misses" << endl;
+    }
+  }
+
+
+  /* report the memory of each tracker, of the path table they share,
+   * and the most memory all of them held at any one time, only if
+   * the user bounds it or asks for it */
+  if (max_memory > 0 || verbose) {
+    mpileaks_report_memory();
+  }
 
   if (myrank == 0) {
     cout << "----------------------------------------------------------------------" << endl;
@@ -377,6 +716,63 @@ int MPI_Init(int* argc, char** argv[])
     }
   }
 
+  /* select the stack unwinder, the default may be set at configure
+   * time and the user can override it at run time */
+#ifdef MPILEAKS_UNWINDER
+  unwinder = mpileaks_unwind_lookup(MPILEAKS_UNWINDER);
+  if (unwinder < 0) {
+    unwinder = MPILEAKS_UNWIND_CALLPATH;
+  }
+#endif
+  if ((value = getenv("MPILEAKS_UNWINDER")) != NULL) {
+    int id = mpileaks_unwind_lookup(value);
+    if (id >= 0) {
+      unwinder = id;
+    } else if (myrank == 0) {
+      cerr << "mpileaks: Unknown or unsupported MPILEAKS_UNWINDER=" << value
+           << ", using " << mpileaks_unwind_name(unwinder) << endl;
+    }
+  }
+
+  /* look up call paths in the call-site cache before walking the stack */
+  if ((value = getenv("MPILEAKS_CALLSITE_CACHE")) != NULL) {
+    callsite_cache = atoi(value);
+    if (callsite_cache && (depth < 1 || depth > 2) && myrank == 0) {
+      cerr << "mpileaks: MPILEAKS_CALLSITE_CACHE only applies with "
+           << "MPILEAKS_STACK_DEPTH of 1 or 2" << endl;
+    }
+  }
+
+  /* capture only one in N allocations per call site,
+   * attribute the others to the last path captured there */
+  if ((value = getenv("MPILEAKS_SAMPLE_RATE")) != NULL) {
+    sample_rate = atoi(value);
+    if (sample_rate < 1) {
+      sample_rate = 1;
+    }
+  }
+
+  /* limit the time we spend in mpileaks to this percentage of
+   * wall time by capturing less and less of each call path */
+  if ((value = getenv("MPILEAKS_MAX_OVERHEAD")) != NULL) {
+    max_overhead = atof(value);
+    if (max_overhead < 0.0) {
+      max_overhead = 0.0;
+    }
+  }
+  overhead_start = PMPI_Wtime();
+
+  /* limit the memory of our trackers to this many bytes by
+   * summarizing their entries by callpath when they hold more */
+  if ((value = getenv("MPILEAKS_MAX_MEMORY")) != NULL) {
+    max_memory = mpileaks_parse_bytes(value);
+  }
+
+  /* report how much memory mpileaks itself took */
+  if ((value = getenv("MPILEAKS_VERBOSE")) != NULL) {
+    verbose = atoi(value);
+  }
+
   enabled = 1;
   return rc;
 }
@@ -404,6 +800,14 @@ int MPI_Finalize()
   enabled = 0;
   int rc = PMPI_Finalize();
 
+  /* empty all trackers and give their memory back in one go */
+  list<Callpath2Count*>::iterator it;
+  for (it = h2cpc_objs->begin(); it != h2cpc_objs->end(); it++) {
+    (*it)->clear();
+  }
+  mpileaks_path_table_clear();
+  mpileaks_slab_release();
+
   /* free off our runtime object */
   if (runtime != NULL) {
     delete runtime;
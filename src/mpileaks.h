@@ -11,12 +11,15 @@
 #define _MPILEAKS_H_
 
 #include <map>
-#include <set>
-#include <stack>
 #include <list>
 #include <utility>                       // pair
 #include "CallpathRuntime.h"             // Callpath
 #include "callpath2count.h"                // Callpath2Count, callpath_count_t
+#include "unwind.h"                        // mpileaks_unwind
+#include "pathtable.h"                     // path_id_t
+#include "handlemap.h"                     // HandleMap
+#include "allocset.h"                      // AllocSet
+#include "pathstack.h"                     // PathStack
 
 
 using namespace std; 
@@ -25,75 +28,242 @@ using namespace std;
 extern int enabled;
 extern int depth;
 extern int chop;
+extern int unwinder;
+extern int callsite_cache;
+extern int sample_rate;
+extern int capture;
+extern double max_overhead;
+extern size_t max_memory;
 extern CallpathRuntime *runtime;
 
 
 
+/* Capture levels, mpileaks steps down through these when its own
+ * cost exceeds MPILEAKS_MAX_OVERHEAD percent of the wall time */
+enum mpileaks_capture {
+  MPILEAKS_CAPTURE_FULL = 0,   /* paths as deep as MPILEAKS_STACK_DEPTH */
+  MPILEAKS_CAPTURE_SHALLOW,    /* at most MPILEAKS_SHALLOW_DEPTH frames */
+  MPILEAKS_CAPTURE_CALLSITE,   /* only the call site */
+  MPILEAKS_CAPTURE_COUNTS      /* no paths, only count objects */
+};
+
+#define MPILEAKS_SHALLOW_DEPTH 4
+
+/* the time a tracker spends in mpileaks and the capture level it
+ * stepped down to, each tracker throttles itself, so that a hot
+ * wrapper does not cut back the call paths of all others */
+struct mpileaks_throttle_t {
+  double time;          /* spent in mpileaks since the start of window */
+  double window;        /* wall time at which we started measuring */
+  unsigned long calls;  /* number of calls measured so far */
+  int capture;          /* capture level of this tracker */
+};
+
+/* bracket the work done by mpileaks in a wrapper to measure the
+ * overhead of its tracker, only used if max_overhead is set */
+double mpileaks_overhead_begin();
+void mpileaks_overhead_end(mpileaks_throttle_t* throttle, double start);
+
+/* evict the older entries of all trackers if their tables hold more
+ * than max_memory bytes, only used if max_memory is set */
+void mpileaks_memory_check();
+
+
+/* bytes an entry of a tracker holds in the slabs besides its slot,
+ * only entries that can grow hold any */
+template<class U> inline size_t mpileaks_spilled_bytes(const U& entry) {
+  return 0;
+}
+
+inline size_t mpileaks_spilled_bytes(const AllocSet& allocs) {
+  return allocs.spilled_bytes();
+}
+
+inline size_t mpileaks_spilled_bytes(const PathStack& paths) {
+  return paths.spilled_bytes();
+}
+
+
 /*
  * Abstract class (cannot be instantiated): 
  * Handle to callpath container (Handle2CPC).  
  * Associate a handle of type T with a callpath container of type U. 
  * 
+ * D is the class that is finally instantiated, which derives from
+ * this one (e.g., MPI_Comm2CallpathSet).  It must provide
+ *   bool is_handle_null(T handle)
+ *   void add_callpath(T handle, path_id_t path)
+ *   void remove_callpath(myiterator it, size_t start)
+ *   int summarize(const U& entry, path2count_t& callpath2count)
+ * where summarize adds the callpaths of an entry to the counts
+ * and returns the number of objects it stands for.
+ * We call these through D rather than through virtual functions,
+ * so that they inline into allocate and free.  Only the functions
+ * used to build the report are virtual.
+ * 
+ * The start argument of allocate and free counts the frames to drop
+ * from a callpath, beginning with the frame of the function it is
+ * passed to.  Each function passes start+1 to the function it calls,
+ * so every function in between must keep its own frame: allocate,
+ * free, free_many and get_callpath are never inlined, while
+ * free_handle, free_disabled and remove_callpath are always inlined
+ * into their caller and pass start on unchanged.
+ * 
  * Note: Forced to include full definition of member functions 
  * to avoid linking errors. This occurs because this class is a
  * template and is being used in a different file. 
  */ 
-template<class T, class U> class Handle2CPC : public Callpath2Count
+template<class T, class U, class D> class Handle2CPC : public Callpath2Count
 {
  private: 
   /******************************************************
    * Alias for iterator of class member 
    ******************************************************/
-  typedef typename map<T,U>::iterator myiterator; 
+  typedef typename HandleMap<T,U>::iterator myiterator; 
 
 
 public:
   /******************************************************
-   * Virtual destructor required to avoid compiler warning
+   * Constructor and virtual destructor
+   * (destructor required to avoid compiler warning)
    ******************************************************/
+  Handle2CPC(const char* name) : Callpath2Count(name) {
+    throttle.time    = 0.0;
+    throttle.window  = 0.0;
+    throttle.calls   = 0;
+    throttle.capture = MPILEAKS_CAPTURE_FULL;
+  }
+
   virtual ~Handle2CPC() {
   }
 
-  
-  /******************************************************
-   * Pure virtual functions, define in derived classes 
-   ******************************************************/
-  virtual bool is_handle_null(T handle) = 0; 
-  virtual void add_callpath(T handle, Callpath path) = 0; 
-  virtual void remove_callpath(myiterator it, size_t start) = 0; 
 
 
   /******************************************************
    * Auxiliary functions
    ******************************************************/
-  Callpath get_callpath(size_t start) {
-    /* we wait to create our runtime object as late as possible
-     * because it registers the SIGSEGV signal within stackwalker
-     * and we want to override any previous registrations for this
-     * signal, in particular by MPI  */
-    if (runtime == NULL) {
-      runtime = new CallpathRuntime;
-    }
-
-    /* get the current call path */
-    Callpath path = runtime->doStackwalk();
-
-    /* assume we want the entire path going all the way up to main(),
-     * unless depth is specified, then just take the number requested */
-    size_t size = path.size();
-    size_t end = size;
-    if (depth > -1) {
-      end = start + depth;
-      if (end > size) {
-        end = size;
+  /* capture the current call path and return its id in the path table,
+   * start counts the frames to drop, beginning with this function,
+   * so neither this function nor its callers in mpileaks may be
+   * inlined, or we would drop frames of the application instead */
+  __attribute__((noinline)) path_id_t get_callpath(size_t start) {
+    /* when throttled all the way down, just count objects */
+    int level = get_capture();
+    if (level == MPILEAKS_CAPTURE_COUNTS) {
+      return mpileaks_path_add_pcs(NULL, 0);
+    }
+
+    /* limit the depth of the path according to our capture level */
+    int max_depth = depth;
+    if (level == MPILEAKS_CAPTURE_SHALLOW &&
+        (max_depth < 0 || max_depth > MPILEAKS_SHALLOW_DEPTH))
+    {
+      max_depth = MPILEAKS_SHALLOW_DEPTH;
+    } else if (level == MPILEAKS_CAPTURE_CALLSITE) {
+      max_depth = 1;
+    }
+
+    /* the call-site key only tells sites apart, the path we report
+     * for it is still walked with the selected unwinder, so we get
+     * the key with backtrace() rather than Stackwalker */
+    int fast = unwinder;
+    if (fast == MPILEAKS_UNWIND_CALLPATH) {
+      fast = MPILEAKS_UNWIND_BACKTRACE;
+    }
+
+    /* The call-site cache is keyed on the frames we report, so it
+     * is only used if we report at most two frames.  A hit is then
+     * the same path we would capture, deeper paths can differ in
+     * frames the key does not cover. */
+    int use_cache = (callsite_cache && max_depth > 0 && max_depth <= 2);
+
+    /* identify the call site, and with the cache its caller, which
+     * are the frames just past the mpileaks layers */
+    path_cache_key key;
+    void* sig[MPILEAKS_UNWIND_MAX_FRAMES];
+    size_t nsig = 0;
+    if (use_cache || sample_rate > 1) {
+      nsig = mpileaks_unwind(fast, sig, start + (use_cache ? max_depth : 1));
+      key.site   = (start < nsig) ? sig[start] : NULL;
+      key.caller = (use_cache && max_depth > 1 && start + 1 < nsig) ? sig[start + 1] : NULL;
+      key.start  = start;
+    }
+
+    /* when sampling, only one in sample_rate calls from a site
+     * captures its path, the others reuse the last one as estimate */
+    if (sample_rate > 1) {
+      path_id_t estimated;
+      if (mpileaks_path_sample_find(key.site, key.start, sample_rate, &estimated)) {
+        return estimated;
       }
     }
 
-    /* chop off frames that are within the mpileaks code itself,
-     * and only show frames up to certain depth along path to main() */
-    Callpath sliced = path.slice(start, end);
-    
-    return sliced;
+    /* check whether we have already captured a path from this call site */
+    if (use_cache) {
+      path_id_t cached;
+      if (mpileaks_path_cache_find(key, &cached)) {
+        return cached;
+      }
+    }
+
+    path_id_t path;
+    if (use_cache && unwinder != MPILEAKS_UNWIND_CALLPATH) {
+      /* the key already holds the frames we keep */
+      if (start > nsig) {
+        start = nsig;
+      }
+      path = mpileaks_path_add_pcs(&sig[start], nsig - start);
+    } else if (unwinder != MPILEAKS_UNWIND_CALLPATH) {
+      /* capture return addresses with the fast unwinder the user
+       * selected, if depth is specified stop unwinding once we have
+       * the frames we keep rather than walking up to main() */
+      size_t max = MPILEAKS_UNWIND_MAX_FRAMES;
+      if (max_depth > -1 && start + max_depth < max) {
+        max = start + max_depth;
+      }
+
+      /* only record the frames we actually keep, these are
+       * translated into a Callpath when we report */
+      void* pcs[MPILEAKS_UNWIND_MAX_FRAMES];
+      size_t size = mpileaks_unwind(unwinder, pcs, max);
+      if (start > size) {
+        start = size;
+      }
+      path = mpileaks_path_add_pcs(&pcs[start], size - start);
+    } else {
+      /* we wait to create our runtime object as late as possible
+       * because it registers the SIGSEGV signal within stackwalker
+       * and we want to override any previous registrations for this
+       * signal, in particular by MPI  */
+      if (runtime == NULL) {
+        runtime = new CallpathRuntime;
+      }
+
+      /* get the current call path, Stackwalker always walks all the
+       * way up to main() */
+      Callpath full = runtime->doStackwalk();
+
+      /* if depth is specified, just take the number requested */
+      size_t end = full.size();
+      if (max_depth > -1 && start + max_depth < end) {
+        end = start + max_depth;
+      }
+      if (start > end) {
+        start = end;
+      }
+
+      /* chop off frames that are within the mpileaks code itself,
+       * and only keep frames up to depth along the path to main() */
+      path = mpileaks_path_add_callpath(full, start, end);
+    }
+
+    if (use_cache) {
+      mpileaks_path_cache_add(key, path);
+    }
+    if (sample_rate > 1) {
+      mpileaks_path_sample_add(key.site, key.start, path);
+    }
+    return path;
   }
 
 
@@ -101,161 +271,414 @@ public:
    * The main functions of this class. Derived classes 
    * that are instantiated use these functions. 
    ******************************************************/
-  void allocate(T &handle, size_t start) {
+  __attribute__((noinline)) void allocate(T &handle, size_t start) {
     if (enabled) {
-      if ( !is_handle_null(handle) ) {
+      double overhead = 0.0;
+      if (max_overhead > 0.0) {
+        overhead = mpileaks_overhead_begin();
+      }
+
+      if ( !derived().is_handle_null(handle) ) {
 	/* get the call path where this request was allocated,
          * chop layers of mpileaks and internal MPI calls */
-	Callpath path = get_callpath(start+1);
+	path_id_t path = get_callpath(start+1);
+
+        /* a handle value we still track may be allocated again */
+        if ( !older.empty() ) {
+          promote(handle);
+        }
 	
 	/* associate handle with callpath */ 	
-	add_callpath(handle, path); 
+	derived().add_callpath(handle, path); 
+
+        if (max_memory > 0) {
+          mpileaks_memory_check();
+        }
       } 
+
+      if (max_overhead > 0.0) {
+        mpileaks_overhead_end(&throttle, overhead);
+      }
+    } else if ( !derived().is_handle_null(handle) ) {
+      /* tracking is disabled, e.g., by MPI_Pcontrol(0), just remember
+       * the handle so that we know it when it is freed later on */
+      untracked[handle]++;
+
+      if (max_memory > 0) {
+        mpileaks_memory_check();
+      }
     }
   }
   
-  void free(T &handle, size_t start) {
+  __attribute__((noinline)) void free(T &handle, size_t start) {
     if (enabled) {
-      if ( !is_handle_null(handle) ) {
-	/* lookup stack based on handle value */
-	myiterator it = handle2cpc.find(handle);
-	if ( it != handle2cpc.end() )
-	  /* found handle entry, decrease count associated with handle */ 
-	  remove_callpath(it, start+1); 
-	else {
-	  /* Non-null handle being freed but not found in handle2cpc,
-           * capture the callpath of the free call to report later */
-	  Callpath path = get_callpath(start+1);
-	  
-	  /* increase callpath count for this free call */
-	  increase_count(missing_alloc, path, 1); 
-        }
+      double overhead = 0.0;
+      if (max_overhead > 0.0) {
+        overhead = mpileaks_overhead_begin();
+      }
+
+      free_handle(handle, start+1);
+
+      if (max_overhead > 0.0) {
+        mpileaks_overhead_end(&throttle, overhead);
+      }
+    } else {
+      free_disabled(handle, start+1);
+    }
+  }
+
+  /* free count handles at once, e.g., all requests completed by one
+   * MPI_Waitall, same as calling free on each of them, but with one
+   * call, one check of enabled and one overhead measurement for the
+   * whole batch, and with free_handle inlined into the loop */
+  __attribute__((noinline)) void free_many(const T* handles, int count, size_t start) {
+    if (enabled) {
+      double overhead = 0.0;
+      if (max_overhead > 0.0) {
+        overhead = mpileaks_overhead_begin();
+      }
+
+      int i;
+      for (i = 0; i < count; i++) {
+        free_handle(handles[i], start+1);
+      }
+
+      if (max_overhead > 0.0) {
+        mpileaks_overhead_end(&throttle, overhead);
+      }
+    } else {
+      int i;
+      for (i = 0; i < count; i++) {
+        free_disabled(handles[i], start+1);
       }
     }
   }
+
+  /* summarize the entries we set aside at the last eviction by
+   * callpath and drop them, keeping only fingerprints of their handles,
+   * then set aside the entries we track now, so an entry is only
+   * evicted if it is still outstanding after the next eviction,
+   * see mpileaks_memory_check */
+  void evict() {
+    if ( !older.empty() ) {
+      evicted_handles.begin(older.size());
+    }
+    myiterator it; 
+    for (it = older.begin(); it != older.end(); it++) {
+      evicted_objects += derived().summarize(it->second, evicted); 
+      evicted_handles.insert(handle_bits(it->first));
+    }
+    if ( !older.empty() ) {
+      evicted_handles.end();
+    }
+    older.clear();
+    older.swap(handle2cpc);
+
+    evict_untracked();
+  }
+
+  /* bytes that evict can free, we skip the few entries that spilled,
+   * as we'd have to walk the tables to find them */
+  size_t evictable_bytes() {
+    return handle2cpc.bytes() + older.bytes() + untracked.bytes();
+  }
+
+  /* move the entries we set aside back, so reports see them all */
+  void merge_older() {
+    myiterator it; 
+    for (it = older.begin(); it != older.end(); it++) {
+      swap(handle2cpc[it->first], it->second);
+    }
+    older.clear();
+  }
+
+  void clear() {
+    handle2cpc.clear();
+    older.clear();
+    untracked.clear();
+    untracked_handles.clear();
+    Callpath2Count::clear();
+  }
+
+  /* the capture level of this tracker, unless the path table ran
+   * out of ids and the whole process only counts objects */
+  int get_capture() {
+    return (capture > throttle.capture) ? capture : throttle.capture;
+  }
+
+  void get_memory(size_t* entries, size_t* bytes, size_t* peak) {
+    Callpath2Count::get_memory(entries, bytes, peak);
+    *entries += handle2cpc.size() + older.size() + untracked.size();
+    *bytes   += handle2cpc.bytes() + older.bytes() + untracked.bytes() + untracked_handles.bytes();
+    *peak    += handle2cpc.peak_bytes() + older.peak_bytes() + untracked.peak_bytes() +
+                untracked_handles.bytes();
+
+    /* entries that hold more than fits in their slot */
+    myiterator it; 
+    for (it = handle2cpc.begin(); it != handle2cpc.end(); it++) {
+      *bytes += mpileaks_spilled_bytes(it->second);
+    }
+    for (it = older.begin(); it != older.end(); it++) {
+      *bytes += mpileaks_spilled_bytes(it->second);
+    }
+  }
   
  protected:
+  /* drop one reference to handle, always inlined into free and
+   * free_many, as is remove_callpath, so that start counts the
+   * frames from either of those to the application */
+  inline __attribute__((always_inline)) void free_handle(const T &handle, size_t start) {
+    if ( !derived().is_handle_null(handle) ) {
+      /* lookup stack based on handle value */
+      myiterator it = handle2cpc.find(handle);
+      if ( it == handle2cpc.end() && !older.empty() ) {
+        it = promote(handle);
+      }
+      if ( it != handle2cpc.end() )
+	/* found handle entry, decrease count associated with handle */ 
+	derived().remove_callpath(it, start); 
+      else if ( free_untracked(handle) ) {
+	/* allocated while tracking was disabled */ 
+      } else if ( free_evicted(handle) ) {
+	/* the handle of an object we evicted */ 
+      } else {
+	/* Non-null handle being freed but not found in handle2cpc,
+	 * capture the callpath of the free call to report later */
+	path_id_t path = get_callpath(start);
+	
+	/* increase callpath count for this free call */
+	increase_count(missing_alloc, path, 1); 
+      }
+    }
+  }
+
+  /* move the entry of handle from the entries set aside for eviction
+   * back to handle2cpc, returns it, or end() if we don't hold it */
+  myiterator promote(const T &handle) {
+    myiterator it = older.find(handle);
+    if ( it == older.end() ) {
+      return handle2cpc.end();
+    }
+    swap(handle2cpc[handle], it->second);
+    older.erase(it);
+    return handle2cpc.find(handle);
+  }
+
+  /* drop one reference to a handle freed while tracking is disabled,
+   * always inlined into free and free_many like free_handle, if we
+   * track the handle its object is gone and must not be reported,
+   * but we capture no callpath for a handle we don't know */
+  inline __attribute__((always_inline)) void free_disabled(const T &handle, size_t start) {
+    if ( derived().is_handle_null(handle) ) {
+      return;
+    }
+    myiterator it = handle2cpc.end();
+    if ( !handle2cpc.empty() ) {
+      it = handle2cpc.find(handle);
+    }
+    if ( it == handle2cpc.end() && !older.empty() ) {
+      it = promote(handle);
+    }
+    if ( it != handle2cpc.end() ) {
+      derived().remove_callpath(it, start);
+    } else if ( !free_untracked(handle) ) {
+      free_evicted(handle);
+    }
+  }
+
+  /* count a free of an object we evicted, or rarely of one whose
+   * fingerprint matches one of theirs, returns 0 if we did not
+   * evict the handle */
+  inline int free_evicted(const T &handle) {
+    if ( evicted_freed < evicted_objects &&
+         evicted_handles.contains(handle_bits(handle)) )
+    {
+      evicted_freed++;
+      return 1;
+    }
+    return 0;
+  }
+
+  /* drop one reference to a handle allocated while tracking was
+   * disabled, returns 0 if we don't know the handle */
+  inline int free_untracked(const T &handle) {
+    if ( !untracked.empty() ) {
+      typename HandleMap<T, int>::iterator it = untracked.find(handle);
+      if ( it != untracked.end() ) {
+        if ( --(it->second) == 0 ) {
+          untracked.erase(it);
+        }
+        return 1;
+      }
+    }
+    return is_evicted_untracked(handle);
+  }
+
+  /* return 1 if we dropped handle from untracked at an eviction */
+  int is_evicted_untracked(const T &handle) {
+    return ( !untracked_handles.empty() &&
+             untracked_handles.contains(handle_bits(handle)) );
+  }
+
+  /* keep only fingerprints of the untracked handles, they have no
+   * callpath to summarize, and a free of one of them is still known
+   * not to be that of an object we never saw allocated */
+  void evict_untracked() {
+    if ( untracked.empty() ) {
+      return;
+    }
+    untracked_handles.begin(untracked.size());
+    typename HandleMap<T, int>::iterator it;
+    for (it = untracked.begin(); it != untracked.end(); it++) {
+      untracked_handles.insert(handle_bits(it->first));
+    }
+    untracked_handles.end();
+    untracked.clear();
+  }
+
+  /* the instantiated class, which defines is_handle_null,
+   * add_callpath and remove_callpath */
+  D& derived() {
+    return *static_cast<D*>(this);
+  }
+
+  /* our overhead and capture level, see mpileaks_overhead_end */
+  mpileaks_throttle_t throttle;
+
   /* handle to callpath-container */ 
-  map<T, U> handle2cpc;
+  HandleMap<T, U> handle2cpc;
+
+  /* entries set aside at the last eviction, evicted at the next one
+   * unless they are freed or allocated again, a handle is in at most
+   * one of the two maps */
+  HandleMap<T, U> older;
+
+  /* handles allocated while tracking was disabled, with the number
+   * of times each was allocated, we don't capture their callpaths */
+  HandleMap<T, int> untracked;
+
+  /* fingerprints of the untracked handles we evicted */
+  EvictFilter untracked_handles;
 }; 
 
 
 
 /*
  * Abstract class Handle2Set:  
- * Associate a 'handle' with a pair '(set_of_callpaths, count)'. 
- *   'count': number of active allocate calls using 'handle'. 
- *   'set_of_callpaths': callpaths associated with allocate requests;
- *                       they are not freed until count is zero. 
+ * Associate a 'handle' with the set of its outstanding allocations. 
+ * Each allocation records its callpath and a generation, which
+ * grows with every allocate call, so that when an MPI library reuses
+ * a handle value we still track, a free is matched with the newest
+ * allocation of the handle rather than with a set of callpaths. 
  * This class covers the general case where one handle can be associated with
- * multiple callpaths. 
+ * multiple callpaths.  The set is an AllocSet, which keeps the single
+ * allocation of most handles inline rather than in a heap node.
  */
-template<class T> class Handle2Set : public Handle2CPC< T, pair<set<Callpath>,int> >
+template<class T, class D> class Handle2Set : public Handle2CPC< T, AllocSet, D >
 {
  private:
   /******************************************************
    * Alias for iterator of class member 
    ******************************************************/
-  typedef typename map< T, pair<set<Callpath>,int> >::iterator myiterator; 
+  typedef typename HandleMap<T, AllocSet>::iterator myiterator; 
   
  public:
-  void add_callpath(T handle, Callpath path) {
-    /* locate map entry associated with handle */ 
-    if ( this->handle2cpc.find(handle) != this->handle2cpc.end() ) {
-      /* handle found */ 
-      this->handle2cpc[handle].second++;
-    } else {
-      /* handle not found, initialize count */ 
-      this->handle2cpc[handle].second = 1;
-    }
-    
-    /* insert path to the set of callpaths associated with handle */ 
-    /* map[handle].set_of_callpaths.insert */ 
-    this->handle2cpc[handle].first.insert( path );
+  Handle2Set(const char* name) : Handle2CPC<T, AllocSet, D>(name), generation(0) {
+  }
+
+  void add_callpath(T handle, path_id_t path) {
+    /* locate map entry associated with handle, inserting an
+     * empty entry if the handle is not found */ 
+    AllocSet& allocs = this->handle2cpc[handle];
+    generation++;
+    allocs.push(path, generation);
   }
   
-  void remove_callpath(myiterator it, size_t start) {
-    if ( it->second.first.empty() || it->second.second <= 0 ) {
-      /* handle being freed but no callpaths in set,
+  inline __attribute__((always_inline)) void remove_callpath(myiterator it, size_t start) {
+    if ( it->second.empty() ) {
+      /* handle being freed but no allocations in set,
        * capture the callpath of the free call to report later */
-      Callpath path = this->get_callpath(start+1);
+      path_id_t path = this->get_callpath(start);
       
       /* increase callpath count for this free call */
       this->increase_count(this->missing_alloc, path, 1); 
       
       /* clean-up map entry */ 
-      if ( !it->second.first.empty() ) { 
-	it->second.first.clear(); 
-      }
       this->handle2cpc.erase( it ); 
     } else { 
-      /* if count decreases to 0, remove entry */ 
-      /* it->pair.count */ 
-      if (--(it->second.second) == 0) {
-	/* drop all callpaths in set */ 
-	it->second.first.clear();
+      /* the free matches the newest allocation of the handle, which
+       * is the one the application got the handle from, retire its
+       * generation and remove the entry once no allocations are left */ 
+      AllocSet& allocs = it->second;
+      allocs.retire( allocs.newest().generation );
+      if ( allocs.empty() ) {
 	/* erase map entry */ 
 	this->handle2cpc.erase(it); 
       }
     }
   }
 
-  /* identify all handles that map to a single callpath,
-   * and for the union of all such callpaths, sum the total outstanding count by callpath */
+  int summarize(const AllocSet& allocs, path2count_t& callpath2count) {
+    AllocSet::const_iterator it_set; 
+    for ( it_set = allocs.begin(); it_set != allocs.end(); it_set++ ) { 
+      this->increase_count(callpath2count, it_set->path, 1);
+    }
+    return allocs.size();
+  }
+
+  /* A handle with a single outstanding allocation, or whose
+   * allocations all come from the same callpath, is a definite leak. 
+   * Otherwise the newest allocation is, as that is where the
+   * application got the handle from, while the older ones are only
+   * possible leaks: their free may have been missed, or they may be
+   * references to the same object, e.g., from MPI_Comm_group.
+   * For the union of all such callpaths, sum the total outstanding count by callpath */
   int get_definite_leaks(list<callpath_count_t> &lst) {
     /* we use this to sum counts by callpath */
-    map<Callpath,int> tmp_callpath2count;
+    path2count_t tmp_callpath2count;
     
-    /* Iterate over map of handle to set of callpaths */ 
+    /* Iterate over map of handle to set of allocations */ 
     myiterator it_map; 
     for ( it_map = this->handle2cpc.begin(); 
 	  it_map != this->handle2cpc.end(); it_map++ )
     { 
-      
-      /* If there's only one leak source (definite) */ 
-      if ( it_map->second.first.size() == 1 ) {
-#if 0
-	cerr << "ea: definite: setsize = " << it_map->second.first.size() 
-	     << " count = " << it_map->second.second << endl; 
-#endif 
-	Callpath path = *(it_map->second.first.begin()); 
-	int count = it_map->second.second; 
-        this->increase_count(tmp_callpath2count, path, count);
+      const AllocSet& allocs = it_map->second; 
+      if ( allocs.empty() ) {
+        continue;
       }
+
+      path_id_t path = allocs.newest().path; 
+      int count = 1;
+      if ( single_callpath(allocs) ) {
+        count = allocs.size();
+      }
+      this->increase_count(tmp_callpath2count, path, count);
     }
 
     /* now build a list of counts by callpath */
     return this->map2list(tmp_callpath2count, lst);
   }
   
-  /* identify all handles that map to more than one callpath,
-   * and for the union of all such callpaths, sum the total outstanding count by callpath */
+  /* sum the older allocations of handles with allocations from more
+   * than one callpath, see get_definite_leaks */
   int get_possible_leaks(list<callpath_count_t> &lst) {
     /* we use this to sum counts by callpath */
-    map<Callpath,int> tmp_callpath2count;
+    path2count_t tmp_callpath2count;
 
-    /* Iterate over map of handle to set of callpaths */ 
+    /* Iterate over map of handle to set of allocations */ 
     myiterator it_map; 
     for ( it_map = this->handle2cpc.begin(); 
 	  it_map != this->handle2cpc.end(); it_map++ )
     { 
-      
-      /* If there's more than one possible leak source */ 
-      if ( it_map->second.first.size() > 1 ) { 
-#if 0
-	cerr << "ea: possible: setsize = " << it_map->second.first.size() 
-	     << " count = " << it_map->second.second << endl; 
-#endif 
-	/* Iterate over the set of callpaths */ 
-        set<Callpath>::iterator it_set; 
-	for ( it_set = it_map->second.first.begin(); 
-	      it_set != it_map->second.first.end(); it_set++ )
-        { 
-	  /* Flatten the set of callpaths into a list with the set's count */ 
-	  Callpath path = *it_set; 
-	  int count = it_map->second.second; 
-          this->increase_count(tmp_callpath2count, path, count);
-	}
+      const AllocSet& allocs = it_map->second; 
+      if ( single_callpath(allocs) ) {
+        continue;
+      }
+
+      /* Iterate over all but the newest allocation */ 
+      AllocSet::const_iterator it_set; 
+      for ( it_set = allocs.begin(); it_set != allocs.end() - 1; it_set++ ) { 
+        this->increase_count(tmp_callpath2count, it_set->path, 1);
       }
     }
     
@@ -266,37 +689,62 @@ template<class T> class Handle2Set : public Handle2CPC< T, pair<set<Callpath>,in
   void print_outstanding() {
     myiterator it; 
     for (it = this->handle2cpc.begin(); it != this->handle2cpc.end(); it++) {
-      cout << "handle=" << it->first << " count=" << it->second.second << endl; 
+      cout << "handle=" << it->first << " count=" << it->second.size()
+           << " generation=" << it->second.newest().generation << endl; 
+    }
+  }
+
+ private:
+  /* return 1 if all allocations in the set come from one callpath,
+   * an estimated path stands for the same call site as the exact
+   * path it was sampled from */
+  int single_callpath(const AllocSet& allocs) {
+    if ( allocs.size() <= 1 ) {
+      return 1;
+    }
+
+    path_id_t exact = mpileaks_path_exact( allocs.newest().path );
+    AllocSet::const_iterator it_set; 
+    for ( it_set = allocs.begin(); it_set != allocs.end(); it_set++ ) { 
+      if ( mpileaks_path_exact(it_set->path) != exact ) {
+        return 0;
+      }
     }
+    return 1;
   }
+
+  /* generation of the last allocation */
+  uint32_t generation;
 };
 
 
 
 /*
  * Abstract class Handle2Callpath.
- * Derived classes of this class need to define: 
+ * Derived classes of this class pass themselves as D and need to define: 
  *   bool is_handle_null(T handle)
  * This class uses 'callpath' as a callpath container. 
  * This is the simplest usage of a callpath container where a 
  * handle is associated with only one callpath. 
  */
-template<class T> class Handle2Callpath : public Handle2CPC<T, Callpath>
+template<class T, class D> class Handle2Callpath : public Handle2CPC<T, path_id_t, D>
 {
  private:
   /******************************************************
    * Alias for iterator of class member 
    ******************************************************/
-  typedef typename map<T,Callpath>::iterator myiterator; 
+  typedef typename HandleMap<T,path_id_t>::iterator myiterator; 
 
  public:
-  void add_callpath(T handle, Callpath path) {
+  Handle2Callpath(const char* name) : Handle2CPC<T, path_id_t, D>(name) {
+  }
+
+  void add_callpath(T handle, path_id_t path) {
     /* locate map entry associated with handle */ 
     myiterator it = this->handle2cpc.find(handle); 
 
     if ( it == this->handle2cpc.end() ) { 
       this->handle2cpc[handle] = path; 
-      this->increase_count( callpath2count, path, 1 ); 
     } else {
       /* found handle! */ 
       cerr << "mpileaks: Internal Error: Handle2Callpath: "
@@ -306,54 +754,64 @@ template<class T> class Handle2Callpath : public Handle2CPC<T, Callpath>
     }
   }
 
-  void remove_callpath(myiterator it, size_t start) {
-    /* get callpath and update path in callpath2count */ 
-    this->decrease_count( callpath2count, it->second, 1 );
-
+  inline __attribute__((always_inline)) void remove_callpath(myiterator it, size_t start) {
     /* rm entry from handle to callpath_container */ 
     this->handle2cpc.erase( it ); 
   }
 
+  int summarize(const path_id_t& path, path2count_t& callpath2count) {
+    this->increase_count(callpath2count, path, 1);
+    return 1;
+  }
+
+  /* sum the outstanding count by callpath, we only need this
+   * when reporting so we don't keep it up to date as we go */
   int get_definite_leaks(list<callpath_count_t> &lst) {
-    return this->map2list(callpath2count, lst); 
+    path2count_t tmp_callpath2count;
+
+    myiterator it_map; 
+    for ( it_map = this->handle2cpc.begin(); 
+	  it_map != this->handle2cpc.end(); it_map++ )
+    { 
+      this->increase_count(tmp_callpath2count, it_map->second, 1);
+    }
+
+    return this->map2list(tmp_callpath2count, lst); 
   }
 
   int get_possible_leaks(list<callpath_count_t> &lst) {
     return 0; 
   }
-  
-
- protected: 
-  /* map of callpath to count */ 
-  map<Callpath, int> callpath2count; 
 };
 
 
 /*
  * Abstract class Handle2Stack.
- * Derived classes of this class need to define: 
+ * Derived classes of this class pass themselves as D and need to define: 
  *   bool is_handle_null(T handle)
  * This class uses 'stack<callpath>' as a callpath container. 
- * A handle is associated with a stack of callpaths. 
+ * A handle is associated with a stack of callpaths.  The stack is a
+ * PathStack, which holds the first few callpaths of a handle inline.
  */
-template<class T> class Handle2Stack : public Handle2CPC< T, stack<Callpath> >
+template<class T, class D> class Handle2Stack : public Handle2CPC< T, PathStack, D >
 {
  private:
   /******************************************************
    * Alias for iterator of class member 
    ******************************************************/
-  typedef typename map< T, stack<Callpath> >::iterator myiterator; 
+  typedef typename HandleMap< T, PathStack >::iterator myiterator; 
   
  public:
-  void add_callpath(T handle, Callpath path) {
+  Handle2Stack(const char* name) : Handle2CPC<T, PathStack, D>(name) {
+  }
+
+  void add_callpath(T handle, path_id_t path) {
     this->handle2cpc[handle].push( path ); 
-    this->increase_count( callpath2count, path, 1 ); 
   }
   
-  void remove_callpath(myiterator it, size_t start) {
+  inline __attribute__((always_inline)) void remove_callpath(myiterator it, size_t start) {
     if ( !it->second.empty() ) {
-      /* pop callpath from stack and update callpath2count */ 
-      this->decrease_count( callpath2count, it->second.top(), 1 );
+      /* pop callpath from stack */ 
       it->second.pop(); 
 
       /* if stack is empty, delete entry */ 
@@ -363,28 +821,227 @@ template<class T> class Handle2Stack : public Handle2CPC< T, stack<Callpath> >
     } else {
       /* handle being freed without any associated callpaths; 
        * capture the callpath of the free call to report later */
-      Callpath path = this->get_callpath(start+1);
+      path_id_t path = this->get_callpath(start);
 
       /* increase callpath count for this free call */
       this->increase_count( this->missing_alloc, path, 1 );
     }
   }
+
+  int summarize(const PathStack& paths, path2count_t& callpath2count) {
+    size_t i;
+    for (i = 0; i < paths.size(); i++) {
+      this->increase_count(callpath2count, paths[i], 1);
+    }
+    return paths.size();
+  }
   
   /* Todo: need to think about what definite and possible 
      mean in this context. For now, using same policy as if 
      a one-to-one mapping of handle to callpath exists. */ 
   int get_definite_leaks(list<callpath_count_t> &lst) {
-    return this->map2list(callpath2count, lst); 
+    /* sum the outstanding count by callpath over all stacks */
+    path2count_t tmp_callpath2count;
+
+    myiterator it_map; 
+    for ( it_map = this->handle2cpc.begin(); 
+	  it_map != this->handle2cpc.end(); it_map++ )
+    { 
+      summarize(it_map->second, tmp_callpath2count);
+    }
+
+    return this->map2list(tmp_callpath2count, lst); 
   }
 
   int get_possible_leaks(list<callpath_count_t> &lst) {
     return 0; 
   }
+};
+
+
+
+/* state of a persistent object, see Handle2Persistent */
+struct persistent_state {
+  path_id_t path;   /* where the object was allocated */
+  int active;       /* 1 if started and not completed yet */
+};
+
+/*
+ * Abstract class Handle2Persistent.
+ * Derived classes of this class pass themselves as D and need to define: 
+ *   bool is_handle_null(T handle)
+ * Tracks persistent objects, e.g., persistent requests, which are
+ * allocated once (MPI_Send_init), then started (MPI_Start) and
+ * completed (MPI_Wait) any number of times, and finally freed
+ * (MPI_Request_free).  We only capture the callpath of the
+ * allocation.  Starting and completing just set and clear a flag,
+ * so a loop that restarts the same requests costs no stackwalk.
+ * Objects that are never freed are reported as leaks, and those that
+ * are still active at the end as started but not completed, both by
+ * the callpath of their allocation.
+ */
+template<class T, class D> class Handle2Persistent : public Handle2CPC<T, persistent_state, D>
+{
+ private:
+  /******************************************************
+   * Alias for iterator of class member 
+   ******************************************************/
+  typedef typename HandleMap<T, persistent_state>::iterator myiterator; 
+
+ public:
+  Handle2Persistent(const char* name) : Handle2CPC<T, persistent_state, D>(name), nactive(0) {
+  }
+
+  void add_callpath(T handle, path_id_t path) {
+    /* a handle that is reused before we saw it freed, the MPI library
+     * must have freed the earlier object without us seeing it, or the
+     * application lost track of it, so it is a possible leak, as are
+     * the older allocations of a reused handle in Handle2Set */
+    myiterator it = this->handle2cpc.find(handle);
+    if ( it != this->handle2cpc.end() ) {
+      if ( it->second.active ) {
+        nactive--;
+      }
+      this->increase_count(reused, it->second.path, 1);
+    }
+
+    persistent_state& state = this->handle2cpc[handle];
+    state.path   = path;
+    state.active = 0;
+  }
+
+  inline __attribute__((always_inline)) void remove_callpath(myiterator it, size_t start) {
+    /* freeing an active object is allowed, it is deallocated
+     * once it completes, so there is nothing to report */
+    if ( it->second.active ) {
+      nactive--;
+    }
+    this->handle2cpc.erase( it ); 
+  }
+
+  int summarize(const persistent_state& state, path2count_t& callpath2count) {
+    this->increase_count(callpath2count, state.path, 1);
+    return 1;
+  }
+
+  /* persistent objects are few and live long, and we would lose
+   * their state, so we keep them when the others are evicted, only
+   * the handles allocated while tracking was disabled are dropped */
+  void evict() {
+    this->evict_untracked();
+  }
+
+  size_t evictable_bytes() {
+    return this->untracked.bytes();
+  }
+
+  void clear() {
+    nactive = 0;
+    reused.clear();
+    Handle2CPC<T, persistent_state, D>::clear();
+  }
+
+  void get_memory(size_t* entries, size_t* bytes, size_t* peak) {
+    Handle2CPC<T, persistent_state, D>::get_memory(entries, bytes, peak);
+    *bytes += reused.bytes();
+    *peak  += reused.peak_bytes();
+  }
+
+  /* return 1 if we track no objects at all */
+  int empty() {
+    return this->handle2cpc.empty();
+  }
+
+  /* return 1 if no object is started and not completed, so that
+   * completions of arrays of requests need no lookups at all */
+  int none_active() {
+    return (nactive == 0);
+  }
+
+  /* return 1 if we track handle, with or without its callpath */
+  int is_tracked(T handle) {
+    if ( !this->handle2cpc.empty() &&
+         this->handle2cpc.find(handle) != this->handle2cpc.end() )
+    {
+      return 1;
+    }
+    if ( !this->untracked.empty() &&
+         this->untracked.find(handle) != this->untracked.end() )
+    {
+      return 1;
+    }
+    return this->is_evicted_untracked(handle);
+  }
+
+  /* mark handle as started, returns 0 if we don't track handle */
+  int start(T handle) {
+    if ( this->handle2cpc.empty() ) {
+      return 0;
+    }
+    myiterator it = this->handle2cpc.find(handle); 
+    if ( it == this->handle2cpc.end() ) {
+      return 0;
+    }
+    if ( !it->second.active ) {
+      it->second.active = 1;
+      nactive++;
+    }
+    return 1;
+  }
+
+  /* mark handle as completed, returns 0 if we don't track handle */
+  int complete(T handle) {
+    if ( this->handle2cpc.empty() ) {
+      return 0;
+    }
+    myiterator it = this->handle2cpc.find(handle); 
+    if ( it == this->handle2cpc.end() ) {
+      return 0;
+    }
+    if ( it->second.active ) {
+      it->second.active = 0;
+      nactive--;
+    }
+    return 1;
+  }
+
+  int get_definite_leaks(list<callpath_count_t> &lst) {
+    return sum_by_callpath(lst, 0);
+  }
+
+  /* objects whose handle was allocated again before they were freed */
+  int get_possible_leaks(list<callpath_count_t> &lst) {
+    return this->map2list(reused, lst); 
+  }
+
+  int get_started_leaks(list<callpath_count_t> &lst) {
+    return sum_by_callpath(lst, 1);
+  }
+
+ private:
+  /* sum the outstanding count by callpath of all objects,
+   * or of only the active ones */
+  int sum_by_callpath(list<callpath_count_t> &lst, int only_active) {
+    path2count_t tmp_callpath2count;
+
+    myiterator it_map; 
+    for ( it_map = this->handle2cpc.begin(); 
+	  it_map != this->handle2cpc.end(); it_map++ )
+    { 
+      if ( !only_active || it_map->second.active ) {
+        this->increase_count(tmp_callpath2count, it_map->second.path, 1);
+      }
+    }
+
+    return this->map2list(tmp_callpath2count, lst); 
+  }
 
+  /* number of objects started and not completed yet */
+  size_t nactive;
 
- protected: 
-  /* map of callpath to count */ 
-  map<Callpath, int> callpath2count;   
+  /* callpaths of objects whose handle was allocated again before we
+   * saw them freed, with the number of such objects */
+  path2count_t reused;
 };
 
 
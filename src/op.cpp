@@ -14,9 +14,12 @@
 /*
  * Track allocation and freeing of user-defined reduction ops.
  */ 
-static class MPI_Op2CallpathSet : public Handle2Set<MPI_Op>
+static class MPI_Op2CallpathSet : public Handle2Set<MPI_Op, MPI_Op2CallpathSet>
 {
 public: 
+  MPI_Op2CallpathSet() : Handle2Set<MPI_Op, MPI_Op2CallpathSet>("MPI_Op") {
+  }
+
   bool is_handle_null(MPI_Op handle) {
     return (handle == MPI_OP_NULL) ? 1 : 0; 
   }
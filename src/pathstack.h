@@ -0,0 +1,139 @@
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+#ifndef _PATHSTACK_H_
+#define _PATHSTACK_H_
+
+#include <stddef.h>
+#include <vector>
+#include <algorithm>                     // swap
+#include "pathtable.h"                   // path_id_t
+#include "slab.h"                        // SlabAllocator
+
+using namespace std;
+
+
+/* number of path ids a PathStack holds without allocating */
+#define PATHSTACK_INLINE 2
+
+/*
+ * Stack of path ids associated with a handle by Handle2Stack.
+ * std::stack sits on a std::deque, which allocates a chunk of several
+ * hundred bytes for every handle even if it only ever holds one path.
+ * We keep the bottom PATHSTACK_INLINE ids inline and only put the ids
+ * above those in an array allocated from the slabs, see slab.h.
+ */
+class PathStack
+{
+ public:
+  typedef vector< path_id_t, SlabAllocator<path_id_t> > path_vector;
+
+  PathStack() : count(0), more(NULL) {
+    ids[0] = 0;
+    ids[1] = 0;
+  }
+
+  PathStack(const PathStack& other) : count(0), more(NULL) {
+    *this = other;
+  }
+
+  ~PathStack() {
+    slab_delete(more);
+  }
+
+  PathStack& operator=(const PathStack& other) {
+    if (this != &other) {
+      slab_delete(more);
+      more = NULL;
+      if (other.more != NULL) {
+        more = slab_new(*other.more);
+      }
+      ids[0] = other.ids[0];
+      ids[1] = other.ids[1];
+      count  = other.count;
+    }
+    return *this;
+  }
+
+  size_t size() const {
+    return count + ((more != NULL) ? more->size() : 0);
+  }
+
+  bool empty() const {
+    return count == 0;
+  }
+
+  /* return the i-th id from the bottom of the stack */
+  path_id_t operator[](size_t i) const {
+    if (i < count) {
+      return ids[i];
+    }
+    return (*more)[i - count];
+  }
+
+  path_id_t top() const {
+    if (more != NULL && !more->empty()) {
+      return more->back();
+    }
+    return ids[count - 1];
+  }
+
+  void push(path_id_t id) {
+    if (count < PATHSTACK_INLINE) {
+      ids[count] = id;
+      count++;
+      return;
+    }
+
+    if (more == NULL) {
+      more = slab_new(path_vector());
+    }
+    more->push_back(id);
+  }
+
+  void pop() {
+    if (more != NULL && !more->empty()) {
+      more->pop_back();
+      if (more->empty()) {
+        slab_delete(more);
+        more = NULL;
+      }
+      return;
+    }
+    count--;
+  }
+
+  /* bytes held in the slabs besides the stack itself */
+  size_t spilled_bytes() const {
+    if (more == NULL) {
+      return 0;
+    }
+    return sizeof(path_vector) + more->capacity() * sizeof(path_id_t);
+  }
+
+  void swap(PathStack& other) {
+    std::swap(ids[0], other.ids[0]);
+    std::swap(ids[1], other.ids[1]);
+    std::swap(count,  other.count);
+    std::swap(more,   other.more);
+  }
+
+ private:
+  path_id_t ids[PATHSTACK_INLINE];  /* bottom of the stack */
+  unsigned int count;               /* number of ids used in ids[] */
+  path_vector* more;                /* ids above those, if any */
+};
+
+/* let containers move entries without copying the array */
+inline void swap(PathStack& a, PathStack& b) {
+  a.swap(b);
+}
+
+
+#endif   // _PATHSTACK_H_
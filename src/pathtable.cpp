@@ -0,0 +1,600 @@
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <iostream>
+#include <vector>
+#include <map>
+
+#include "pathtable.h"
+#include "unwind.h"                       // mpileaks_pcs2callpath
+#include "fingerprint.h"                  // mpileaks_fingerprint
+#include "mpileaks.h"                     // capture
+#include "slab.h"                         // SlabAllocator
+
+using namespace std;
+
+
+/* Captured paths are stored in a calling context tree, in which each
+ * node holds one frame and points to the node of its caller, with
+ * main() near the root.  Paths from the same application share
+ * everything above the point where they diverge, so each frame is
+ * stored once per tree edge rather than once per path, and a path is
+ * just the node of its innermost frame. */
+typedef uint32_t cct_id_t;
+
+/* A frame is the return address captured by a fast unwinder, or the
+ * (module, offset) pair of a frame walked by the Callpath runtime.
+ * We store the latter with the index of its module plus one in the
+ * top bits, which are zero in user-space return addresses, so a
+ * node tells which kind of path it belongs to. */
+#define CCT_MODULE_SHIFT 48
+#define CCT_OFFSET_MASK  ((((uint64_t) 1) << CCT_MODULE_SHIFT) - 1)
+#define CCT_MODULE_MAX   ((uint64_t) 0xffff)
+
+struct cct_node {
+  uint64_t pc;       /* frame, see above */
+  cct_id_t parent;   /* node of the calling frame */
+  path_id_t entry;   /* path ending at this node, if any */
+};
+
+#define CCT_NONE ((cct_id_t) -1)
+#define CCT_ROOT ((cct_id_t) 0)
+
+/* initial number of slots in the child table, a power of two,
+ * a slot holds the child node, whose parent and frame are the key */
+#define CCT_SLOTS 1024
+
+/* one entry per distinct path, a path either ends at a node
+ * of the calling context tree or was captured as a Callpath */
+struct path_entry {
+  cct_id_t node;     /* innermost frame, or CCT_NONE */
+  path_id_t canonical; /* first entry that resolves to the same path */
+  path_id_t exact;     /* path an estimated entry was sampled from */
+  path_id_t estimated; /* estimated twin of an exact entry, if any */
+  Callpath* path;    /* NULL until the path has been resolved */
+  uint64_t fingerprint; /* of the (module, offset) frames, once resolved */
+};
+
+/* marks an estimated twin that has not been created yet */
+#define PATH_ID_NONE ((path_id_t) -1)
+
+/* the empty path, which the root of the tree stands for, we create
+ * its entry first so we still have it when we run out of ids */
+#define PATH_ID_EMPTY ((path_id_t) 0)
+
+/* These are allocated on first use, since trackers may capture
+ * paths before our own static objects have been constructed.  The
+ * tree and the entries live in the slabs with the tables of the
+ * trackers, so they count against MPILEAKS_MAX_MEMORY and are given
+ * back in MPI_Finalize, see mpileaks_path_table_clear. */
+typedef vector< cct_node, SlabAllocator<cct_node> > cct_node_vector;
+typedef vector< cct_id_t, SlabAllocator<cct_id_t> > cct_slot_vector;
+typedef vector< path_entry, SlabAllocator<path_entry> > path_entry_vector;
+
+/* nodes of the calling context tree, the root has no frame */
+static cct_node_vector* cct_nodes = NULL;
+
+/* open addressing table to find the child of a node */
+static cct_slot_vector* cct_slots = NULL;
+static size_t cct_slots_used = 0;
+
+/* entries indexed by path id */
+static path_entry_vector* path_entries = NULL;
+
+/* ids of resolved paths, including those captured as Callpath objects */
+static map<Callpath, path_id_t>* path_callpaths = NULL;
+
+/* modules of frames walked by the Callpath runtime, by index */
+static vector<ModuleId>* cct_modules = NULL;
+static map<ModuleId, uint64_t>* cct_module_index = NULL;
+
+
+static void path_table_init()
+{
+  if (path_entries == NULL) {
+    path_entries   = slab_new(path_entry_vector());
+    path_callpaths = new map<Callpath, path_id_t>;
+    cct_modules      = new vector<ModuleId>;
+    cct_module_index = new map<ModuleId, uint64_t>;
+
+    cct_node root;
+    root.pc     = 0;
+    root.parent = CCT_NONE;
+    root.entry  = PATH_ID_EMPTY;
+    cct_nodes = slab_new(cct_node_vector(1, root));
+
+    cct_slots = slab_new(cct_slot_vector(CCT_SLOTS, CCT_NONE));
+    cct_slots_used = 0;
+
+    path_entry entry;
+    entry.node        = CCT_ROOT;
+    entry.path        = NULL;
+    entry.canonical   = PATH_ID_EMPTY;
+    entry.exact       = PATH_ID_EMPTY;
+    entry.estimated   = PATH_ID_NONE;
+    entry.fingerprint = 0;
+    path_entries->push_back(entry);
+  }
+}
+
+/* We hand out 32-bit ids for entries and nodes.  Should we ever run
+ * out of them, we stop capturing paths rather than reuse ids, and
+ * only count objects under the empty path from then on, the report
+ * notes that we did so. */
+static path_id_t path_table_full()
+{
+  if (capture != MPILEAKS_CAPTURE_COUNTS) {
+    cerr << "mpileaks: Too many distinct call paths, "
+         << "counting objects without their call paths from now on" << endl;
+    capture = MPILEAKS_CAPTURE_COUNTS;
+  }
+  return PATH_ID_EMPTY;
+}
+
+/* fingerprint of the return addresses, only meaningful in this process */
+static uint64_t path_hash(void* const* pcs, size_t count)
+{
+  return mpileaks_fingerprint((const uintptr_t*) pcs, count);
+}
+
+static size_t cct_slot_index(cct_id_t parent, uint64_t pc, size_t mask)
+{
+  uint64_t hash = (pc ^ ((uint64_t) parent << 32)) * 0x9e3779b97f4a7c15ULL;
+  return (size_t) (hash >> 32) & mask;
+}
+
+/* double the size of the child table and rehash its slots */
+static void cct_slots_grow()
+{
+  cct_slot_vector* old_slots = cct_slots;
+  cct_slots = slab_new(cct_slot_vector(old_slots->size() * 2, CCT_NONE));
+
+  size_t mask = cct_slots->size() - 1;
+  cct_slot_vector::iterator it;
+  for (it = old_slots->begin(); it != old_slots->end(); it++) {
+    if (*it != CCT_NONE) {
+      const cct_node& child = (*cct_nodes)[*it];
+      size_t i = cct_slot_index(child.parent, child.pc, mask);
+      while ((*cct_slots)[i] != CCT_NONE) {
+        i = (i + 1) & mask;
+      }
+      (*cct_slots)[i] = *it;
+    }
+  }
+
+  slab_delete(old_slots);
+}
+
+/* return the child of parent for the frame pc, adding it if needed,
+ * returns CCT_NONE if we are out of node ids */
+static cct_id_t cct_child(cct_id_t parent, uint64_t pc)
+{
+  /* keep the table at most half full so probes stay short */
+  if ((cct_slots_used + 1) * 2 > cct_slots->size()) {
+    cct_slots_grow();
+  }
+
+  size_t mask = cct_slots->size() - 1;
+  size_t i = cct_slot_index(parent, pc, mask);
+  while (1) {
+    cct_id_t& slot = (*cct_slots)[i];
+    if (slot == CCT_NONE) {
+      /* not found, add a new node */
+      if (cct_nodes->size() >= (size_t) CCT_NONE) {
+        return CCT_NONE;
+      }
+
+      cct_node node;
+      node.pc     = pc;
+      node.parent = parent;
+      node.entry  = PATH_ID_NONE;
+      cct_nodes->push_back(node);
+
+      slot = (cct_id_t) (cct_nodes->size() - 1);
+      cct_slots_used++;
+      return slot;
+    }
+    const cct_node& child = (*cct_nodes)[slot];
+    if (child.parent == parent && child.pc == pc) {
+      return slot;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+/* add an entry and return its id, or PATH_ID_NONE if we are out of ids */
+static path_id_t path_entry_add(cct_id_t node, Callpath* path)
+{
+  path_entry entry;
+  entry.node = node;
+  entry.path = path;
+
+  size_t id = path_entries->size();
+  if (id >= (size_t) PATH_ID_NONE) {
+    return PATH_ID_NONE;
+  }
+
+  entry.canonical = (path_id_t) id;
+  entry.exact     = (path_id_t) id;
+  entry.estimated = PATH_ID_NONE;
+  entry.fingerprint = 0;
+  path_entries->push_back(entry);
+  return (path_id_t) id;
+}
+
+
+/* return the id of the path ending at node, the first path
+ * to end at a node creates its entry */
+static path_id_t cct_entry(cct_id_t node)
+{
+  if ((*cct_nodes)[node].entry == PATH_ID_NONE) {
+    path_id_t id = path_entry_add(node, NULL);
+    if (id == PATH_ID_NONE) {
+      return path_table_full();
+    }
+    (*cct_nodes)[node].entry = id;
+  }
+  return (*cct_nodes)[node].entry;
+}
+
+
+path_id_t mpileaks_path_add_pcs(void* const* pcs, size_t count)
+{
+  path_table_init();
+
+  /* descend from the outermost frame to the innermost one */
+  cct_id_t node = CCT_ROOT;
+  size_t i = count;
+  while (i > 0) {
+    i--;
+    node = cct_child(node, (uint64_t) (uintptr_t) pcs[i]);
+    if (node == CCT_NONE) {
+      return path_table_full();
+    }
+  }
+
+  return cct_entry(node);
+}
+
+
+/* return the index of module plus one, see CCT_MODULE_SHIFT */
+static uint64_t cct_module(const ModuleId& module)
+{
+  map<ModuleId, uint64_t>::iterator it = cct_module_index->find(module);
+  if (it != cct_module_index->end()) {
+    return it->second;
+  }
+
+  cct_modules->push_back(module);
+  uint64_t index = cct_modules->size();
+  (*cct_module_index)[module] = index;
+  return index;
+}
+
+/* return the id of a path we can't store in the tree */
+static path_id_t path_add_whole(const Callpath& path)
+{
+  map<Callpath, path_id_t>::iterator it = path_callpaths->find(path);
+  if (it != path_callpaths->end()) {
+    return it->second;
+  }
+
+  path_id_t id = path_entry_add(CCT_NONE, NULL);
+  if (id == PATH_ID_NONE) {
+    return path_table_full();
+  }
+  (*path_entries)[id].path = new Callpath(path);
+  (*path_entries)[id].fingerprint = mpileaks_fingerprint_callpath(path);
+  (*path_callpaths)[path] = id;
+  return id;
+}
+
+
+path_id_t mpileaks_path_add_callpath(const Callpath& path, size_t start, size_t end)
+{
+  path_table_init();
+
+  /* descend from the outermost frame to the innermost one,
+   * consecutive frames are often in the same module */
+  cct_id_t node = CCT_ROOT;
+  const ModuleId* last_module = NULL;
+  uint64_t module = 0;
+  size_t i = end;
+  while (i > start) {
+    i--;
+    const FrameId& frame = path[i];
+    if (last_module == NULL || *last_module != frame.module) {
+      module = cct_module(frame.module);
+      last_module = &frame.module;
+    }
+
+    /* a frame that doesn't fit into the encoding is very unlikely,
+     * but then we just keep the whole path */
+    if (module > CCT_MODULE_MAX || (uint64_t) frame.offset > CCT_OFFSET_MASK) {
+      return path_add_whole(path.slice(start, end));
+    }
+
+    node = cct_child(node, (module << CCT_MODULE_SHIFT) | (uint64_t) frame.offset);
+    if (node == CCT_NONE) {
+      return path_table_full();
+    }
+  }
+
+  return cct_entry(node);
+}
+
+
+Callpath mpileaks_path_resolve(path_id_t id)
+{
+  /* an estimated entry resolves to the path it was sampled from */
+  id = (*path_entries)[id].exact;
+
+  path_entry& entry = (*path_entries)[id];
+  if (entry.path == NULL) {
+    /* collect the frames walking up to the root */
+    vector<uint64_t> pcs;
+    cct_id_t node = entry.node;
+    while (node != CCT_ROOT) {
+      pcs.push_back((*cct_nodes)[node].pc);
+      node = (*cct_nodes)[node].parent;
+    }
+
+    Callpath path;
+    if (!pcs.empty() && (pcs[0] >> CCT_MODULE_SHIFT) != 0) {
+      /* frames the Callpath runtime resolved for us */
+      vector<FrameId> frames;
+      frames.reserve(pcs.size());
+      size_t i;
+      for (i = 0; i < pcs.size(); i++) {
+        const ModuleId& module = (*cct_modules)[(pcs[i] >> CCT_MODULE_SHIFT) - 1];
+        frames.push_back(FrameId(module, (uintptr_t) (pcs[i] & CCT_OFFSET_MASK)));
+      }
+      path = Callpath::create(frames);
+    } else {
+      vector<void*> addrs(pcs.size());
+      size_t i;
+      for (i = 0; i < pcs.size(); i++) {
+        addrs[i] = (void*) (uintptr_t) pcs[i];
+      }
+      path = mpileaks_pcs2callpath(addrs.empty() ? NULL : &addrs[0], addrs.size());
+    }
+
+    /* different return addresses may still resolve to the same
+     * frames, e.g., if a module was reloaded at another address,
+     * map those to the entry that first resolved to this path */
+    map<Callpath, path_id_t>::iterator it = path_callpaths->find(path);
+    if (it != path_callpaths->end()) {
+      entry.canonical = it->second;
+      entry.path = (*path_entries)[it->second].path;
+      entry.fingerprint = (*path_entries)[it->second].fingerprint;
+    } else {
+      (*path_callpaths)[path] = id;
+      entry.path = new Callpath(path);
+      entry.fingerprint = mpileaks_fingerprint_callpath(path);
+    }
+  }
+  return *entry.path;
+}
+
+
+path_id_t mpileaks_path_canonical(path_id_t id)
+{
+  id = (*path_entries)[id].exact;
+  mpileaks_path_resolve(id);
+  return (*path_entries)[id].canonical;
+}
+
+
+uint64_t mpileaks_path_fingerprint(path_id_t id)
+{
+  id = (*path_entries)[id].exact;
+  mpileaks_path_resolve(id);
+  return (*path_entries)[id].fingerprint;
+}
+
+
+path_id_t mpileaks_path_estimated(path_id_t id)
+{
+  id = (*path_entries)[id].exact;
+  if ((*path_entries)[id].estimated == PATH_ID_NONE) {
+    /* the twin has no frames of its own, it only refers back to us,
+     * note that path_entry_add may reallocate path_entries */
+    path_id_t twin = path_entry_add(CCT_NONE, NULL);
+    if (twin == PATH_ID_NONE) {
+      /* out of ids, count the estimates as exact */
+      return id;
+    }
+    (*path_entries)[twin].exact = id;
+    (*path_entries)[id].estimated = twin;
+  }
+  return (*path_entries)[id].estimated;
+}
+
+
+path_id_t mpileaks_path_exact(path_id_t id)
+{
+  return (*path_entries)[id].exact;
+}
+
+
+int mpileaks_path_is_estimated(path_id_t id)
+{
+  return ((*path_entries)[id].exact != id);
+}
+
+
+/***********************************************************
+ *** Call-site cache
+ ***********************************************************/
+
+/* number of entries in the (direct-mapped) cache, a power of two */
+#define PATH_CACHE_SIZE 1024
+
+struct path_cache_entry {
+  path_cache_key key;
+  path_id_t id;
+  int valid;
+};
+
+static path_cache_entry path_cache[PATH_CACHE_SIZE];
+static uint64_t path_cache_hits   = 0;
+static uint64_t path_cache_misses = 0;
+
+static size_t path_cache_index(const path_cache_key& key)
+{
+  void* const words[2] = {key.site, key.caller};
+  uint64_t hash = path_hash(words, 2);
+  hash ^= (uint64_t) key.start;
+  hash *= 1099511628211ULL;
+  return (size_t) (hash ^ (hash >> 32)) & (PATH_CACHE_SIZE - 1);
+}
+
+int mpileaks_path_cache_find(const path_cache_key& key, path_id_t* id)
+{
+  const path_cache_entry& entry = path_cache[path_cache_index(key)];
+  if (entry.valid &&
+      entry.key.site   == key.site   &&
+      entry.key.caller == key.caller &&
+      entry.key.start  == key.start)
+  {
+    *id = entry.id;
+    path_cache_hits++;
+    return 1;
+  }
+  path_cache_misses++;
+  return 0;
+}
+
+void mpileaks_path_cache_add(const path_cache_key& key, path_id_t id)
+{
+  /* replace whatever was there before */
+  path_cache_entry& entry = path_cache[path_cache_index(key)];
+  entry.key   = key;
+  entry.id    = id;
+  entry.valid = 1;
+}
+
+void mpileaks_path_cache_stats(uint64_t* hits, uint64_t* misses)
+{
+  *hits   = path_cache_hits;
+  *misses = path_cache_misses;
+}
+
+
+/***********************************************************
+ *** Sampling
+ ***********************************************************/
+
+/* state of one call site when sampling */
+struct path_sample {
+  unsigned long calls;   /* calls since the site was first sampled */
+  path_id_t last;        /* path captured the last time we sampled */
+};
+
+/* call sites keyed by return address and number of chopped frames */
+static map< pair<void*,size_t>, path_sample >* path_samples = NULL;
+
+int mpileaks_path_sample_find(void* site, size_t start, int rate, path_id_t* id)
+{
+  if (path_samples == NULL) {
+    path_samples = new map< pair<void*,size_t>, path_sample >;
+  }
+
+  map< pair<void*,size_t>, path_sample >::iterator it =
+    path_samples->find(make_pair(site, start));
+  if (it == path_samples->end()) {
+    /* always sample the first call from a site */
+    return 0;
+  }
+
+  it->second.calls++;
+  if (it->second.calls % (unsigned long) rate == 0) {
+    return 0;
+  }
+
+  *id = mpileaks_path_estimated(it->second.last);
+  return 1;
+}
+
+void mpileaks_path_sample_add(void* site, size_t start, path_id_t id)
+{
+  if (path_samples == NULL) {
+    path_samples = new map< pair<void*,size_t>, path_sample >;
+  }
+
+  /* a new site starts with a count of zero */
+  path_sample& sample = (*path_samples)[make_pair(site, start)];
+  sample.last = mpileaks_path_exact(id);
+}
+
+
+/***********************************************************
+ *** Memory
+ ***********************************************************/
+
+void mpileaks_path_table_memory(size_t* paths, size_t* bytes)
+{
+  *paths = 0;
+  *bytes = 0;
+  if (path_entries == NULL) {
+    return;
+  }
+
+  *paths = path_entries->size();
+  *bytes = path_entries->capacity() * sizeof(path_entry) +
+           cct_nodes->capacity() * sizeof(cct_node) +
+           cct_slots->capacity() * sizeof(cct_id_t);
+}
+
+
+/***********************************************************
+ *** Release
+ ***********************************************************/
+
+void mpileaks_path_table_clear()
+{
+  if (path_entries == NULL) {
+    return;
+  }
+
+  /* entries that resolved to the path of an earlier entry share its
+   * Callpath, only the canonical entry owns it */
+  size_t id;
+  for (id = 0; id < path_entries->size(); id++) {
+    path_entry& entry = (*path_entries)[id];
+    if (entry.path != NULL && entry.canonical == (path_id_t) id) {
+      delete entry.path;
+    }
+  }
+
+  slab_delete(path_entries);
+  slab_delete(cct_nodes);
+  slab_delete(cct_slots);
+  delete path_callpaths;
+  delete cct_modules;
+  delete cct_module_index;
+  path_entries     = NULL;
+  cct_nodes        = NULL;
+  cct_slots        = NULL;
+  path_callpaths   = NULL;
+  cct_modules      = NULL;
+  cct_module_index = NULL;
+
+  /* cached and sampled ids are no longer valid */
+  size_t i;
+  for (i = 0; i < PATH_CACHE_SIZE; i++) {
+    path_cache[i].valid = 0;
+  }
+  delete path_samples;
+  path_samples = NULL;
+}
@@ -0,0 +1,105 @@
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+#ifndef _PATHTABLE_H_
+#define _PATHTABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "CallpathRuntime.h"             // Callpath
+
+
+/* Trackers do not keep Callpath objects, they keep the id of an
+ * entry in a per-process path table instead.  The frames of a path
+ * are recorded in a calling context tree shared by all paths, and we
+ * only build the Callpath when a report asks for it.  The fast
+ * unwinders record raw return addresses, which we map to (module,
+ * offset) frames at that point.  Identical paths share one entry, so
+ * two captures of the same path return the same id. */
+typedef uint32_t path_id_t;
+
+/* return the id of the path made of the specified return addresses */
+path_id_t mpileaks_path_add_pcs(void* const* pcs, size_t count);
+
+/* return the id of the path made of frames start to end of a path
+ * walked by the Callpath runtime */
+path_id_t mpileaks_path_add_callpath(const Callpath& path, size_t start, size_t end);
+
+/* return the Callpath for the specified id, translating the return
+ * addresses of the path the first time it is called for an id */
+Callpath mpileaks_path_resolve(path_id_t id);
+
+/* return the id of the first entry that resolves to the same Callpath
+ * as the specified id, so counts can be summed by id before building
+ * the list of Callpath objects for a report */
+path_id_t mpileaks_path_canonical(path_id_t id);
+
+/* return the fingerprint of the resolved path of the specified id,
+ * see fingerprint.h */
+uint64_t mpileaks_path_fingerprint(path_id_t id);
+
+/* return the number of path entries and the bytes that they and the
+ * calling context tree take in the slabs, the table only grows, so
+ * this is also the most it ever took */
+void mpileaks_path_table_memory(size_t* paths, size_t* bytes);
+
+/* drop all paths and ids, the tree and the entries are in the slabs,
+ * so this must come before mpileaks_slab_release */
+void mpileaks_path_table_clear();
+
+
+/* When sampling, allocations that were not sampled are attributed
+ * to the last path sampled at the same call site.  Such counts are
+ * estimates, so they are recorded under an estimated twin of the
+ * sampled id, which resolves to the same Callpath. */
+
+/* return the estimated twin of the specified id */
+path_id_t mpileaks_path_estimated(path_id_t id);
+
+/* return the id an estimated id was sampled from, or id itself */
+path_id_t mpileaks_path_exact(path_id_t id);
+
+/* return 1 if id is an estimated twin, 0 otherwise */
+int mpileaks_path_is_estimated(path_id_t id);
+
+/* Decide whether to capture the path of the current call to the
+ * specified call site, given one in rate calls is sampled.  Returns 0
+ * if the caller should capture the path and record it with
+ * mpileaks_path_sample_add, otherwise returns 1 and sets id to the
+ * estimated id of the last path sampled at this site. */
+int mpileaks_path_sample_find(void* site, size_t start, int rate, path_id_t* id);
+
+/* record the path captured for the specified call site */
+void mpileaks_path_sample_add(void* site, size_t start, path_id_t id);
+
+
+/* The call-site cache remembers the path captured at a call site,
+ * so that later calls from the same site return the same id without
+ * walking the stack with the Callpath runtime.  A site is identified
+ * by the return address into the application and, if two frames are
+ * reported, the return address into its caller.  The key thus holds
+ * every frame of the path, and get_callpath only uses the cache if
+ * paths are at most two frames deep. */
+struct path_cache_key {
+  void* site;        /* return address into the application */
+  void* caller;      /* return address into the caller of the site, or NULL */
+  size_t start;      /* number of frames chopped from the path */
+};
+
+/* look up key in the cache, returns 1 and sets id on a hit */
+int mpileaks_path_cache_find(const path_cache_key& key, path_id_t* id);
+
+/* record the id of the path captured for key */
+void mpileaks_path_cache_add(const path_cache_key& key, path_id_t id);
+
+/* return the number of hits and misses of the cache so far */
+void mpileaks_path_cache_stats(uint64_t* hits, uint64_t* misses);
+
+
+#endif   // _PATHTABLE_H_
@@ -7,6 +7,8 @@
  * For details, see https://github.com/hpc/mpileaks
  * Please also read this file: LICENSE.TXT. */
 
+#include <stdlib.h>
+#include <string.h>
 #include "mpi.h"
 #include "mpileaks.h"                 /* Handle2Set */ 
 
@@ -23,58 +25,190 @@
  * instantiated. This is necessary since it depends on the type of 
  * handle used (e.g., MPI_Request). 
  */ 
-static class MPI_Request2CallpathSet : public Handle2Set<MPI_Request>
+static class MPI_Request2CallpathSet : public Handle2Set<MPI_Request, MPI_Request2CallpathSet>
 {
 public: 
+  MPI_Request2CallpathSet() : Handle2Set<MPI_Request, MPI_Request2CallpathSet>("MPI_Request") {
+  }
+
   bool is_handle_null(MPI_Request handle) {
     return (handle == MPI_REQUEST_NULL) ? 1 : 0; 
   }
 } Request2Callpath; 
 
+/*
+ * Persistent requests are tracked on their own, see Handle2Persistent.
+ * The callpath is captured once in the 'init' call and matched by
+ * MPI_Request_free, while 'start' and the completion calls only mark
+ * the request as active or inactive. 
+ */ 
+static class MPI_Persistent2Callpath : public Handle2Persistent<MPI_Request, MPI_Persistent2Callpath>
+{
+public: 
+  MPI_Persistent2Callpath() : Handle2Persistent<MPI_Request, MPI_Persistent2Callpath>("persistent MPI_Request") {
+  }
+
+  bool is_handle_null(MPI_Request handle) {
+    return (handle == MPI_REQUEST_NULL) ? 1 : 0; 
+  }
+} Persistent2Callpath; 
+
 
 
 /************************************************
  * Auxiliary functions
  ************************************************/
 
-/* allocate memory, make a full copy of the specified request array, and return the copy */
-static MPI_Request* mpileaks_request_copy_array(int count, MPI_Request req[])
+/* Completion calls set the requests they complete to MPI_REQUEST_NULL,
+ * so we copy the request array beforehand to find out which handles
+ * to free.  Rather than allocating a copy on every call, e.g., for an
+ * MPI_Testany in a polling loop, we keep one scratch buffer around.
+ * mpileaks is not thread safe yet, so a single buffer is enough, this
+ * will need to become one per thread once we support threads. */
+static MPI_Request* req_scratch = NULL;
+static int req_scratch_size = 0;
+static int req_scratch_busy = 0;
+
+/* make a full copy of the specified request array and return the copy,
+ * with room for extra requests past the end of the copy */
+static MPI_Request* mpileaks_request_copy_array(int count, MPI_Request req[], int extra)
 {
   if (count <= 0) {
     return NULL;
   }
 
-  MPI_Request* req_copies = (MPI_Request*) malloc(count * sizeof(MPI_Request));
-
-  int i;
-  for (i = 0; i < count; i++) {
-    req_copies[i] = req[i];
+  MPI_Request* req_copies;
+  int size = count + extra;
+  if (req_scratch_busy) {
+    /* a completion call from within another one, e.g., by the
+     * callback of a generalized request, gets a copy of its own */
+    req_copies = (MPI_Request*) malloc(size * sizeof(MPI_Request));
+  } else {
+    if (size > req_scratch_size) {
+      free(req_scratch);
+      req_scratch = (MPI_Request*) malloc(size * sizeof(MPI_Request));
+      req_scratch_size = size;
+    }
+    req_copies = req_scratch;
+    req_scratch_busy = 1;
   }
 
+  memcpy(req_copies, req, count * sizeof(MPI_Request));
+
   return req_copies;
 }
 
-static void mpileaks_request_allocate_array(int count, MPI_Request *reqs, size_t start)
+/* done with a copy returned by mpileaks_request_copy_array */
+static void mpileaks_request_release_array(MPI_Request* req_copies)
+{
+  if (req_copies == NULL) {
+    return;
+  }
+
+  if (req_copies == req_scratch) {
+    req_scratch_busy = 0;
+  } else {
+    free(req_copies);
+  }
+}
+
+/* not inlined, since we count this function as a frame in start */
+static void __attribute__((noinline)) mpileaks_request_allocate_array(int count, MPI_Request *reqs, size_t start)
 {
   int i; 
   for (i = 0; i < count; i++) {
-    Request2Callpath.allocate(reqs[i], start+1); 
+    if (!Persistent2Callpath.start(reqs[i])) {
+      Request2Callpath.allocate(reqs[i], start+1); 
+    }
   }
 }
 
 
-/* given a copy of the request array and a new version, free any requests that
- * have changed to MPI_REQUEST_NULL */
-static void mpileaks_request_free_array(int count, MPI_Request req1[], MPI_Request req2[], size_t start)
+/* number of requests we compare at once when looking for the ones
+ * a completion call has changed */
+#define REQ_DIFF_BLOCK 32
+
+/* given a copy of the request array and a new version, move any requests that
+ * have changed to MPI_REQUEST_NULL to the front of the copy, and return how many */
+static int mpileaks_request_completed(int count, MPI_Request req1[], MPI_Request req2[])
 {
+  /* most blocks of a wide array are unchanged after a call that
+   * completes few requests, or none as in a polling loop, memcmp
+   * tells us so with vector instructions, and we only look at the
+   * requests of blocks that differ */
+  int i, completed = 0;
+  for (i = 0; i < count; i += REQ_DIFF_BLOCK) {
+    int n = count - i;
+    if (n > REQ_DIFF_BLOCK) {
+      n = REQ_DIFF_BLOCK;
+    }
+    if (memcmp(&req1[i], &req2[i], n * sizeof(MPI_Request)) == 0) {
+      continue;
+    }
+
+    int j;
+    for (j = i; j < i + n; j++) {
+      if (req1[j] != MPI_REQUEST_NULL && req2[j] == MPI_REQUEST_NULL) {
+        req1[completed] = req1[j];
+        completed++;
+      }
+    }
+  }
+  return completed;
+}
+
+/* given a copy of the request array, the new version, and the indices
+ * of the requests reported as completed by MPI_Waitsome or MPI_Testsome,
+ * gather the completed requests that changed to MPI_REQUEST_NULL after
+ * the end of the copy, and return how many */
+static int mpileaks_request_completed_indices(int count, MPI_Request req1[], MPI_Request req2[],
+                                              int outcount, int indices[])
+{
+  MPI_Request* done = &req1[count];
+  int i, completed = 0;
+  for (i = 0; i < outcount; i++) {
+    int idx = indices[i];
+    if (req1[idx] != MPI_REQUEST_NULL && req2[idx] == MPI_REQUEST_NULL) {
+      done[completed] = req1[idx];
+      completed++;
+    }
+  }
+  return completed;
+}
+
+
+/* mark the persistent requests of an array as completed, these
+ * remain valid handles and so don't show up in the diff above,
+ * stop looking once no persistent request is started any more */
+static void mpileaks_request_complete_persistent(int count, MPI_Request req[])
+{
+  if (Persistent2Callpath.none_active()) {
+    return;
+  }
+
   int i;
-  for (i = 0; i < count; i++) {
-    if (req1[i] != MPI_REQUEST_NULL && req2[i] == MPI_REQUEST_NULL) {
-      Request2Callpath.free(req1[i], start+1);
+  for (i = 0; i < count && !Persistent2Callpath.none_active(); i++) {
+    if (req[i] != MPI_REQUEST_NULL) {
+      Persistent2Callpath.complete(req[i]);
     }
   }
 }
 
+/* same for the requests reported as completed by MPI_Waitsome or MPI_Testsome */
+static void mpileaks_request_complete_persistent_indices(MPI_Request req[], int outcount, int indices[])
+{
+  if (Persistent2Callpath.none_active()) {
+    return;
+  }
+
+  int i;
+  for (i = 0; i < outcount && !Persistent2Callpath.none_active(); i++) {
+    MPI_Request r = req[indices[i]];
+    if (r != MPI_REQUEST_NULL) {
+      Persistent2Callpath.complete(r);
+    }
+  }
+}
 
 
 /************************************************
@@ -133,7 +267,7 @@ int MPI_Send_init(void* buf, int count, MPI_Datatype datatype, int dest, int tag
 		  MPI_Comm comm, MPI_Request *request)
 {
   int rc = PMPI_Send_init(buf, count, datatype, dest, tag, comm, request); 
-  Request2Callpath.allocate(*request, chop); 
+  Persistent2Callpath.allocate(*request, chop); 
   return rc; 
 }
 
@@ -141,7 +275,7 @@ int MPI_Bsend_init(void* buf, int count, MPI_Datatype datatype, int dest, int ta
 		   MPI_Comm comm, MPI_Request *request)
 {
   int rc = PMPI_Bsend_init(buf, count, datatype, dest, tag, comm, request); 
-  Request2Callpath.allocate(*request, chop); 
+  Persistent2Callpath.allocate(*request, chop); 
   return rc; 
 }
 
@@ -149,7 +283,7 @@ int MPI_Ssend_init(void* buf, int count, MPI_Datatype datatype, int dest, int ta
 		   MPI_Comm comm, MPI_Request *request)
 {
   int rc = PMPI_Ssend_init(buf, count, datatype, dest, tag, comm, request); 
-  Request2Callpath.allocate(*request, chop); 
+  Persistent2Callpath.allocate(*request, chop); 
   return rc; 
 }
 
@@ -157,7 +291,7 @@ int MPI_Rsend_init(void* buf, int count, MPI_Datatype datatype, int dest, int ta
 		   MPI_Comm comm, MPI_Request *request)
 {
   int rc = PMPI_Rsend_init(buf, count, datatype, dest, tag, comm, request); 
-  Request2Callpath.allocate(*request, chop); 
+  Persistent2Callpath.allocate(*request, chop); 
   return rc; 
 }
 
@@ -165,14 +299,16 @@ int MPI_Recv_init(void* buf, int count, MPI_Datatype datatype, int source, int t
 		  MPI_Comm comm, MPI_Request *request)
 {
   int rc = PMPI_Recv_init(buf, count, datatype, source, tag, comm, request); 
-  Request2Callpath.allocate(*request, chop); 
+  Persistent2Callpath.allocate(*request, chop); 
   return rc; 
 }
 
 int MPI_Start(MPI_Request *request)
 {
   int rc = PMPI_Start(request); 
-  Request2Callpath.allocate(*request, chop); 
+  if (!Persistent2Callpath.start(*request)) {
+    Request2Callpath.allocate(*request, chop); 
+  }
   return rc; 
 }
 
@@ -263,7 +399,11 @@ int MPI_Request_free(MPI_Request* req)
   int rc = PMPI_Request_free(req);
 
   if (req_copy != MPI_REQUEST_NULL) {
-    Request2Callpath.free(req_copy, chop);
+    if (Persistent2Callpath.is_tracked(req_copy)) {
+      Persistent2Callpath.free(req_copy, chop);
+    } else {
+      Request2Callpath.free(req_copy, chop);
+    }
   }
 
   return rc;
@@ -275,7 +415,7 @@ int MPI_Wait(MPI_Request* req, MPI_Status* stat)
 
   int rc = PMPI_Wait(req, stat);
 
-  if (req_copy != MPI_REQUEST_NULL) {
+  if (req_copy != MPI_REQUEST_NULL && !Persistent2Callpath.complete(req_copy)) {
     Request2Callpath.free(req_copy, chop);
   }
 
@@ -288,7 +428,7 @@ int MPI_Test(MPI_Request* req, int* flag, MPI_Status* stat)
 
   int rc = PMPI_Test(req, flag, stat);
 
-  if (*flag && req_copy != MPI_REQUEST_NULL) {
+  if (*flag && req_copy != MPI_REQUEST_NULL && !Persistent2Callpath.complete(req_copy)) {
     Request2Callpath.free(req_copy, chop);
   }
 
@@ -297,96 +437,96 @@ int MPI_Test(MPI_Request* req, int* flag, MPI_Status* stat)
 
 int MPI_Waitany(int count, MPI_Request req[], int* index, MPI_Status* stat)
 {
-  MPI_Request* req_copies = mpileaks_request_copy_array(count, req);
+  MPI_Request* req_copies = mpileaks_request_copy_array(count, req, 0);
 
   int rc = PMPI_Waitany(count, req, index, stat);
 
   int idx = *index;
-  if (idx != MPI_UNDEFINED) {
+  if (idx != MPI_UNDEFINED && !Persistent2Callpath.complete(req_copies[idx])) {
     Request2Callpath.free(req_copies[idx], chop);
   }
-  if (req_copies != NULL) {
-    free(req_copies);
-  }
+  mpileaks_request_release_array(req_copies);
 
   return rc;
 }
 
 int MPI_Testany(int count, MPI_Request req[], int* index, int* flag, MPI_Status* stat)
 {
-  MPI_Request* req_copies = mpileaks_request_copy_array(count, req);
+  MPI_Request* req_copies = mpileaks_request_copy_array(count, req, 0);
 
   int rc = PMPI_Testany(count, req, index, flag, stat);
 
   int idx = *index;
-  if (idx != MPI_UNDEFINED && *flag) {
+  if (idx != MPI_UNDEFINED && *flag && !Persistent2Callpath.complete(req_copies[idx])) {
     Request2Callpath.free(req_copies[idx], chop);
   }
-  if (req_copies != NULL) {
-    free(req_copies);
-  }
+  mpileaks_request_release_array(req_copies);
 
   return rc;
 }
 
 int MPI_Waitall(int count, MPI_Request req[], MPI_Status stat[])
 {
-  MPI_Request* req_copies = mpileaks_request_copy_array(count, req);
+  MPI_Request* req_copies = mpileaks_request_copy_array(count, req, 0);
 
   int rc = PMPI_Waitall(count, req, stat);
 
-  mpileaks_request_free_array(count, req_copies, req, chop);
-  if (req_copies != NULL) {
-    free(req_copies);
-  }
+  mpileaks_request_complete_persistent(count, req);
+  int completed = mpileaks_request_completed(count, req_copies, req);
+  Request2Callpath.free_many(req_copies, completed, chop);
+  mpileaks_request_release_array(req_copies);
 
   return rc;
 }
 
 int MPI_Testall(int count, MPI_Request req[], int* flag, MPI_Status stat[])
 {
-  MPI_Request* req_copies = mpileaks_request_copy_array(count, req);
+  MPI_Request* req_copies = mpileaks_request_copy_array(count, req, 0);
 
   int rc = PMPI_Testall(count, req, flag, stat);
 
   /* we can't use the flag value here, since this may complete
    * some but not all requests */
-  mpileaks_request_free_array(count, req_copies, req, chop);
-  if (req_copies != NULL) {
-    free(req_copies);
+  if (*flag) {
+    mpileaks_request_complete_persistent(count, req);
   }
+  int completed = mpileaks_request_completed(count, req_copies, req);
+  Request2Callpath.free_many(req_copies, completed, chop);
+  mpileaks_request_release_array(req_copies);
 
   return rc;
 }
 
 int MPI_Waitsome(int count, MPI_Request req[], int* outcount, int indicies[], MPI_Status stat[])
 {
-  MPI_Request* req_copies = mpileaks_request_copy_array(count, req);
+  MPI_Request* req_copies = mpileaks_request_copy_array(count, req, count);
 
   int rc = PMPI_Waitsome(count, req, outcount, indicies, stat);
 
   if (*outcount != 0 && *outcount != MPI_UNDEFINED) {
-    mpileaks_request_free_array(count, req_copies, req, chop);
-  }
-  if (req_copies != NULL) {
-    free(req_copies);
+    /* only look at the requests that were reported as completed */
+    mpileaks_request_complete_persistent_indices(req, *outcount, indicies);
+    int completed = mpileaks_request_completed_indices(count, req_copies, req, *outcount, indicies);
+    Request2Callpath.free_many(&req_copies[count], completed, chop);
   }
+  mpileaks_request_release_array(req_copies);
 
   return rc;
 }
 
 int MPI_Testsome(int count, MPI_Request req[], int* outcount, int indicies[], MPI_Status stat[])
 {
-  MPI_Request* req_copies = mpileaks_request_copy_array(count, req);
+  MPI_Request* req_copies = mpileaks_request_copy_array(count, req, count);
 
   int rc = PMPI_Testsome(count, req, outcount, indicies, stat);
 
   if (*outcount != 0 && *outcount != MPI_UNDEFINED) {
-    mpileaks_request_free_array(count, req_copies, req, chop);
-  }
-  if (req_copies != NULL) {
-    free(req_copies);
+    /* only look at the requests that were reported as completed */
+    mpileaks_request_complete_persistent_indices(req, *outcount, indicies);
+    int completed = mpileaks_request_completed_indices(count, req_copies, req, *outcount, indicies);
+    Request2Callpath.free_many(&req_copies[count], completed, chop);
   }
+  mpileaks_request_release_array(req_copies);
 
   return rc;
 }
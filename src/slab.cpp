@@ -0,0 +1,188 @@
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <new>                           // bad_alloc
+
+#include "slab.h"
+
+using namespace std;
+
+
+/* bytes we map at a time to carve blocks from */
+#define SLAB_SIZE (256 * 1024)
+
+/* blocks larger than this get a mapping of their own */
+#define SLAB_MAX_BLOCK (32 * 1024)
+
+/* size classes, each power of two and half way to the next one,
+ * which keeps the space lost to rounding under a third */
+static const size_t slab_classes[] = {
+  16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768,
+  1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384, 24576,
+  SLAB_MAX_BLOCK
+};
+
+#define SLAB_NUM_CLASSES (sizeof(slab_classes) / sizeof(size_t))
+
+/* free blocks are linked through their first word */
+struct slab_block {
+  slab_block* next;
+};
+
+/* slabs are linked through their first block */
+struct slab_header {
+  slab_header* next;
+};
+
+static slab_block* slab_free_lists[SLAB_NUM_CLASSES];
+
+static slab_header* slabs = NULL;  /* all slabs we have mapped */
+static char* slab_next = NULL;     /* first unused byte in current slab */
+static char* slab_end  = NULL;     /* end of current slab */
+
+static size_t slab_current = 0;    /* bytes mapped right now */
+static size_t slab_peak    = 0;    /* most bytes ever mapped */
+static size_t slab_in_use  = 0;    /* bytes in blocks handed out */
+
+
+static void* slab_map(size_t size)
+{
+  void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    throw bad_alloc();
+  }
+
+  slab_current += size;
+  if (slab_current > slab_peak) {
+    slab_peak = slab_current;
+  }
+  return ptr;
+}
+
+static void slab_unmap(void* ptr, size_t size)
+{
+  munmap(ptr, size);
+  slab_current -= size;
+}
+
+/* round large blocks up to a whole number of pages */
+static size_t slab_large_size(size_t size)
+{
+  static size_t page = 0;
+  if (page == 0) {
+    page = (size_t) sysconf(_SC_PAGESIZE);
+  }
+  return (size + page - 1) & ~(page - 1);
+}
+
+/* return the index of the smallest class that holds size bytes */
+static size_t slab_class(size_t size)
+{
+  size_t i = 0;
+  while (slab_classes[i] < size) {
+    i++;
+  }
+  return i;
+}
+
+void* mpileaks_slab_alloc(size_t size)
+{
+  if (size > SLAB_MAX_BLOCK) {
+    size_t bytes = slab_large_size(size);
+    slab_in_use += bytes;
+    return slab_map(bytes);
+  }
+
+  /* reuse a free block of this class if we have one */
+  size_t i = slab_class(size);
+  slab_in_use += slab_classes[i];
+  slab_block* block = slab_free_lists[i];
+  if (block != NULL) {
+    slab_free_lists[i] = block->next;
+    return block;
+  }
+
+  /* Blocks of the 24-byte class are only aligned to 8 bytes and all
+   * others to 16 bytes.  The size of a type that needs 16 bytes is a
+   * multiple of 16, so it never falls into the 24-byte class. */
+  size_t bytes = slab_classes[i];
+  size_t align = (bytes % 16 == 0) ? 16 : 8;
+  char* next = (char*) (((uintptr_t) slab_next + align - 1) & ~((uintptr_t) align - 1));
+
+  /* otherwise carve a new one from the current slab, mapping a new
+   * slab if this one is used up, the rest of the old one is lost */
+  if (slab_next == NULL || next > slab_end || (size_t) (slab_end - next) < bytes) {
+    slab_header* slab = (slab_header*) slab_map(SLAB_SIZE);
+    slab->next = slabs;
+    slabs = slab;
+
+    /* keep blocks aligned to 16 bytes past the header */
+    next     = (char*) slab + 16;
+    slab_end = (char*) slab + SLAB_SIZE;
+  }
+
+  slab_next = next + bytes;
+  return next;
+}
+
+void mpileaks_slab_free(void* ptr, size_t size)
+{
+  if (ptr == NULL) {
+    return;
+  }
+
+  if (size > SLAB_MAX_BLOCK) {
+    size_t bytes = slab_large_size(size);
+    slab_in_use -= bytes;
+    slab_unmap(ptr, bytes);
+    return;
+  }
+
+  size_t i = slab_class(size);
+  slab_in_use -= slab_classes[i];
+  slab_block* block = (slab_block*) ptr;
+  block->next = slab_free_lists[i];
+  slab_free_lists[i] = block;
+}
+
+void mpileaks_slab_release()
+{
+  while (slabs != NULL) {
+    slab_header* next = slabs->next;
+    slab_unmap(slabs, SLAB_SIZE);
+    slabs = next;
+  }
+
+  size_t i;
+  for (i = 0; i < SLAB_NUM_CLASSES; i++) {
+    slab_free_lists[i] = NULL;
+  }
+  slab_next = NULL;
+  slab_end  = NULL;
+  slab_in_use = 0;
+}
+
+void mpileaks_slab_footprint(size_t* current, size_t* peak)
+{
+  *current = slab_current;
+  *peak    = slab_peak;
+}
+
+size_t mpileaks_slab_in_use()
+{
+  return slab_in_use;
+}
@@ -0,0 +1,122 @@
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <stddef.h>
+#include <new>                           // placement new
+
+
+/* The containers of the trackers draw their memory from slabs that
+ * mpileaks maps for itself rather than from the heap of the
+ * application.  Blocks are rounded up to a size class and recycled
+ * through a free list per class, large blocks are mapped on their
+ * own.  All slabs are released at once in MPI_Finalize.  Blocks are
+ * aligned to 16 bytes, except for those of the 24-byte class, which
+ * are aligned to 8 bytes and only used for sizes that are not a
+ * multiple of 16. */
+
+/* allocate a block of size bytes */
+void* mpileaks_slab_alloc(size_t size);
+
+/* return a block of size bytes to its free list */
+void mpileaks_slab_free(void* ptr, size_t size);
+
+/* unmap all slabs, the containers must have freed their blocks */
+void mpileaks_slab_release();
+
+/* return the number of bytes currently mapped for blocks and the
+ * largest number of bytes ever mapped */
+void mpileaks_slab_footprint(size_t* current, size_t* peak);
+
+/* return the number of bytes in blocks that have not been freed,
+ * unlike the footprint this drops as soon as blocks are freed */
+size_t mpileaks_slab_in_use();
+
+
+/* allocate and free single objects in the slabs */
+template<class T> inline T* slab_new(const T& value) {
+  return new (mpileaks_slab_alloc(sizeof(T))) T(value);
+}
+
+template<class T> inline void slab_delete(T* ptr) {
+  if (ptr != NULL) {
+    ptr->~T();
+    mpileaks_slab_free(ptr, sizeof(T));
+  }
+}
+
+
+/*
+ * Allocator for STL containers that draws from the slabs.
+ * It has no state, so any two instances can free each other's blocks.
+ */
+template<class T> class SlabAllocator
+{
+ public:
+  typedef T              value_type;
+  typedef T*             pointer;
+  typedef const T*       const_pointer;
+  typedef T&             reference;
+  typedef const T&       const_reference;
+  typedef size_t         size_type;
+  typedef ptrdiff_t      difference_type;
+
+  template<class U> struct rebind {
+    typedef SlabAllocator<U> other;
+  };
+
+  SlabAllocator() {
+  }
+
+  template<class U> SlabAllocator(const SlabAllocator<U>&) {
+  }
+
+  pointer address(reference x) const {
+    return &x;
+  }
+
+  const_pointer address(const_reference x) const {
+    return &x;
+  }
+
+  pointer allocate(size_type n, const void* = 0) {
+    return (pointer) mpileaks_slab_alloc(n * sizeof(T));
+  }
+
+  void deallocate(pointer p, size_type n) {
+    mpileaks_slab_free(p, n * sizeof(T));
+  }
+
+  size_type max_size() const {
+    return ((size_t) -1) / sizeof(T);
+  }
+
+  void construct(pointer p, const T& value) {
+    new ((void*) p) T(value);
+  }
+
+  void destroy(pointer p) {
+    p->~T();
+  }
+};
+
+template<class T, class U>
+inline bool operator==(const SlabAllocator<T>&, const SlabAllocator<U>&) {
+  return true;
+}
+
+template<class T, class U>
+inline bool operator!=(const SlabAllocator<T>&, const SlabAllocator<U>&) {
+  return false;
+}
+
+
+#endif   // _SLAB_H_
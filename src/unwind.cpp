@@ -0,0 +1,279 @@
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>                      // strcasecmp
+#include <unistd.h>                       // readlink
+#include <limits.h>                       // PATH_MAX
+#include <link.h>                         // dl_iterate_phdr
+#include <execinfo.h>                     // backtrace
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#ifdef HAVE_LIBUNWIND
+#include <libunwind.h>                    // unw_backtrace
+#endif
+
+#include "unwind.h"
+
+using namespace std;
+
+
+/* the frame pointer walker relies on the frame record layout
+ * (saved frame pointer followed by return address) */
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+#define MPILEAKS_HAVE_FRAMEPOINTER 1
+#endif
+
+
+/***********************************************************
+ *** Unwinder names
+ ***********************************************************/
+
+static const char* unwinder_names[] = {
+  "callpath",
+  "framepointer",
+  "libunwind",
+  "backtrace"
+};
+
+int mpileaks_unwind_lookup(const char* name)
+{
+  if (name == NULL) {
+    return -1;
+  }
+
+  int id = -1;
+  int i;
+  for (i = 0; i < (int) (sizeof(unwinder_names) / sizeof(char*)); i++) {
+    if (strcasecmp(name, unwinder_names[i]) == 0) {
+      id = i;
+      break;
+    }
+  }
+
+  /* weed out unwinders that are not available in this build */
+#ifndef MPILEAKS_HAVE_FRAMEPOINTER
+  if (id == MPILEAKS_UNWIND_FRAMEPOINTER) {
+    id = -1;
+  }
+#endif
+#ifndef HAVE_LIBUNWIND
+  if (id == MPILEAKS_UNWIND_LIBUNWIND) {
+    id = -1;
+  }
+#endif
+
+  return id;
+}
+
+const char* mpileaks_unwind_name(int id)
+{
+  if (id < 0 || id >= (int) (sizeof(unwinder_names) / sizeof(char*))) {
+    return "unknown";
+  }
+  return unwinder_names[id];
+}
+
+
+/***********************************************************
+ *** Capture return addresses
+ ***********************************************************/
+
+/* must not be inlined, otherwise the frames we skip below
+ * would no longer belong to this function */
+size_t __attribute__((noinline)) mpileaks_unwind(int id, void** pcs, size_t max)
+{
+  void* buf[MPILEAKS_UNWIND_MAX_FRAMES + 1];
+  int n = 0;
+  size_t count = 0;
+
+  if (max > MPILEAKS_UNWIND_MAX_FRAMES) {
+    max = MPILEAKS_UNWIND_MAX_FRAMES;
+  }
+
+  switch (id) {
+#ifdef MPILEAKS_HAVE_FRAMEPOINTER
+  case MPILEAKS_UNWIND_FRAMEPOINTER:
+    {
+      /* each frame record holds the frame pointer of the caller
+       * followed by the return address into the caller */
+      void** fp = (void**) __builtin_frame_address(0);
+      while (fp != NULL && count < max) {
+        void* ra = fp[1];
+        if (ra == NULL) {
+          break;
+        }
+        pcs[count] = ra;
+        count++;
+
+        /* the stack grows down, so the frame of our caller must
+         * be above ours, stop rather than follow a bogus chain
+         * through code compiled without frame pointers */
+        void** next = (void**) fp[0];
+        if (next <= fp ||
+            (uintptr_t) next - (uintptr_t) fp > (1 << 24) ||
+            ((uintptr_t) next & (sizeof(void*) - 1)) != 0)
+        {
+          break;
+        }
+        fp = next;
+      }
+    }
+    return count;
+#endif
+
+#ifdef HAVE_LIBUNWIND
+  case MPILEAKS_UNWIND_LIBUNWIND:
+    n = unw_backtrace(buf, (int) max + 1);
+    break;
+#endif
+
+  case MPILEAKS_UNWIND_BACKTRACE:
+    n = backtrace(buf, (int) max + 1);
+    break;
+
+  default:
+    return 0;
+  }
+
+  /* buf[0] is the return address into this function, drop it */
+  int i;
+  for (i = 1; i < n; i++) {
+    pcs[count] = buf[i];
+    count++;
+  }
+
+  return count;
+}
+
+
+/***********************************************************
+ *** Map return addresses to (module, offset) frames
+ ***********************************************************/
+
+/* address range of one loaded segment of a module */
+struct module_range {
+  uintptr_t start;
+  uintptr_t end;
+  uintptr_t base;    /* load bias, subtract to get offset into module */
+  ModuleId module;
+};
+
+static bool module_range_lt(const module_range& first, const module_range& second)
+{
+  return first.start < second.start;
+}
+
+/* sorted list of loaded segments, rebuilt whenever we find an
+ * address that is not covered, e.g., after a dlopen() */
+static vector<module_range>* module_ranges = NULL;
+
+/* dl_iterate_phdr reports an empty name for the executable */
+static const string& module_exe_name()
+{
+  static string name;
+  if (name.empty()) {
+    char path[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len > 0) {
+      path[len] = '\0';
+      name = path;
+    } else {
+      name = "(unknown)";
+    }
+  }
+  return name;
+}
+
+static int module_ranges_add(struct dl_phdr_info* info, size_t size, void* data)
+{
+  vector<module_range>* ranges = (vector<module_range>*) data;
+
+  const char* name = info->dlpi_name;
+  ModuleId module((name != NULL && name[0] != '\0') ? string(name) : module_exe_name());
+
+  int i;
+  for (i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr)* phdr = &info->dlpi_phdr[i];
+    if (phdr->p_type == PT_LOAD) {
+      module_range range;
+      range.start  = info->dlpi_addr + phdr->p_vaddr;
+      range.end    = range.start + phdr->p_memsz;
+      range.base   = info->dlpi_addr;
+      range.module = module;
+      ranges->push_back(range);
+    }
+  }
+
+  return 0;
+}
+
+static void module_ranges_build()
+{
+  if (module_ranges == NULL) {
+    module_ranges = new vector<module_range>;
+  }
+  module_ranges->clear();
+  dl_iterate_phdr(module_ranges_add, module_ranges);
+  sort(module_ranges->begin(), module_ranges->end(), module_range_lt);
+}
+
+static const module_range* module_ranges_find(uintptr_t pc)
+{
+  if (module_ranges == NULL) {
+    return NULL;
+  }
+
+  /* find the last range starting at or below pc */
+  module_range key;
+  key.start = pc;
+  vector<module_range>::iterator it = upper_bound(
+    module_ranges->begin(), module_ranges->end(), key, module_range_lt
+  );
+  if (it == module_ranges->begin()) {
+    return NULL;
+  }
+  it--;
+  if (pc >= it->end) {
+    return NULL;
+  }
+  return &(*it);
+}
+
+Callpath mpileaks_pcs2callpath(void* const* pcs, size_t count)
+{
+  vector<FrameId> frames;
+  frames.reserve(count);
+
+  size_t i;
+  for (i = 0; i < count; i++) {
+    uintptr_t pc = (uintptr_t) pcs[i];
+    const module_range* range = module_ranges_find(pc);
+    if (range == NULL) {
+      /* perhaps a module was loaded since we last looked */
+      module_ranges_build();
+      range = module_ranges_find(pc);
+    }
+
+    if (range != NULL) {
+      frames.push_back(FrameId(range->module, pc - range->base));
+    } else {
+      frames.push_back(FrameId(ModuleId(), pc));
+    }
+  }
+
+  return Callpath::create(frames);
+}
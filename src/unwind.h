@@ -0,0 +1,49 @@
+/* Copyright (c) 2012, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov> and Edgar A. Leon <leon@llnl.gov>.
+ * LLNL-CODE-557543.
+ * All rights reserved.
+ * This file is part of the mpileaks tool package.
+ * For details, see https://github.com/hpc/mpileaks
+ * Please also read this file: LICENSE.TXT. */
+
+#ifndef _UNWIND_H_
+#define _UNWIND_H_
+
+#include <stddef.h>
+#include "CallpathRuntime.h"             // Callpath
+
+
+/* maximum number of frames captured by the fast unwinders,
+ * deeper stacks are truncated at this many frames */
+#define MPILEAKS_UNWIND_MAX_FRAMES 256
+
+/* Stack unwinders that can be used to capture call paths.
+ * The Callpath/StackwalkerAPI runtime is the fallback, the others
+ * only capture return addresses and map those to (module, offset)
+ * frames themselves. */
+enum mpileaks_unwinder {
+  MPILEAKS_UNWIND_CALLPATH = 0,
+  MPILEAKS_UNWIND_FRAMEPOINTER,
+  MPILEAKS_UNWIND_LIBUNWIND,
+  MPILEAKS_UNWIND_BACKTRACE
+};
+
+/* given the name of an unwinder (as used in MPILEAKS_UNWINDER),
+ * return its id, or -1 if unknown or not compiled in */
+int mpileaks_unwind_lookup(const char* name);
+
+/* return the name of the specified unwinder */
+const char* mpileaks_unwind_name(int id);
+
+/* Fill pcs with up to max return addresses using the specified
+ * (fast) unwinder and return the number of entries captured.
+ * pcs[0] is the return address into the caller of this function,
+ * which matches the first frame of CallpathRuntime::doStackwalk(). */
+size_t mpileaks_unwind(int id, void** pcs, size_t max);
+
+/* translate return addresses into a Callpath of (module, offset) frames */
+Callpath mpileaks_pcs2callpath(void* const* pcs, size_t count);
+
+
+#endif   // _UNWIND_H_
@@ -20,9 +20,12 @@
 /*
  * This class tracks window objects.
  */ 
-static class MPI_Win2CallpathSet : public Handle2Set<MPI_Win>
+static class MPI_Win2CallpathSet : public Handle2Set<MPI_Win, MPI_Win2CallpathSet>
 {
 public: 
+  MPI_Win2CallpathSet() : Handle2Set<MPI_Win, MPI_Win2CallpathSet>("MPI_Win") {
+  }
+
   bool is_handle_null(MPI_Win handle) {
     return (handle == MPI_WIN_NULL) ? 1 : 0; 
   }